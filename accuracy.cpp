@@ -0,0 +1,381 @@
+#include "accuracy.hpp"
+#include "config.hpp"
+#include "consts.hpp"
+#include "elc.hpp"
+#include "reassignment.hpp"
+#include "stft.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <log/log.hpp>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace
+{
+  // -12 dBFS, a triad or a harmonic tone still fits
+  const auto Amplitude = 0x2000;
+  const auto Harmonics = 8;
+  // the peak of a partial is looked for this many bins around its frequency, a miss otherwise
+  const auto SearchBins = 2;
+  // partials closer than the main lobe of the rectangular window are one peak at this size, they
+  // are reported apart and not scored
+  const auto ResolvableBins = 2.f;
+  // the FFT view the smaller sizes have to match
+  const auto ReferenceSize = 32768;
+
+  struct Tone
+  {
+    float freq;
+    float amplitude;
+    float phase;
+  };
+
+  // one frame worth of signal, every tone is a partial to find
+  struct Case
+  {
+    std::vector<Tone> tones;
+    // standard deviation of the white noise
+    float noise;
+    std::mt19937::result_type seed;
+  };
+
+  struct Signal
+  {
+    const char *name;
+    std::vector<Case> cases;
+  };
+
+  // one case per key of the displayed range, detuned by up to half a semitone
+  auto makeSignals() -> std::vector<Signal>
+  {
+    std::mt19937 gen(42);
+    std::uniform_real_distribution<float> detuneDist(-0.5f, 0.5f);
+    std::uniform_real_distribution<float> phaseDist(0.f, 2 * M_PI);
+    std::vector<float> keys;
+    for (auto key = 0;; ++key)
+    {
+      const auto freq = config().startFreq * powf(2.f, (key + detuneDist(gen)) / 12.f);
+      if (freq > config().endFreq)
+        break;
+      keys.push_back(freq);
+    }
+    const auto transpose = [](float freq, int semitones) { return freq * powf(2.f, semitones / 12.f); };
+    std::vector<Signal> res{{"sine", {}}, {"noisy", {}}, {"harmonic", {}}, {"triad", {}}};
+    for (const auto freq : keys)
+    {
+      res[0].cases.push_back({{{freq, Amplitude, phaseDist(gen)}}, 0, gen()});
+      // 20 dB SNR
+      res[1].cases.push_back({{{freq, Amplitude, phaseDist(gen)}}, Amplitude / sqrtf(200.f), gen()});
+      Case harmonic{{}, 0, gen()};
+      for (auto h = 1; h <= Harmonics && h * freq < config().sampleFreq / 2.f; ++h)
+        harmonic.tones.push_back({h * freq, 1.f * Amplitude / h, phaseDist(gen)});
+      res[2].cases.push_back(harmonic);
+      // the major third and the fifth are detuned on their own
+      res[3].cases.push_back({{{freq, Amplitude, phaseDist(gen)},
+                               {transpose(freq, 4) * powf(2.f, detuneDist(gen) / 24.f), Amplitude, phaseDist(gen)},
+                               {transpose(freq, 7) * powf(2.f, detuneDist(gen) / 24.f), Amplitude, phaseDist(gen)}},
+                              0,
+                              gen()});
+    }
+    return res;
+  }
+
+  auto synthesize(const Case &c, std::vector<int16_t> &samples) -> void
+  {
+    std::mt19937 gen(c.seed);
+    std::normal_distribution<float> noiseDist(0.f, std::max(c.noise, 1e-6f));
+    for (auto i = 0U; i < samples.size(); ++i)
+    {
+      auto v = c.noise > 0 ? noiseDist(gen) : 0.f;
+      for (const auto &t : c.tones)
+        v += t.amplitude * sin(2 * M_PI * t.freq * i / config().sampleFreq + t.phase);
+      samples[i] = static_cast<int16_t>(std::clamp(lroundf(v), -0x8000L, 0x7fffL));
+    }
+  }
+
+  enum class Method { Bin, Reassigned, Grid, Count };
+
+  auto toString(Method value) -> const char *
+  {
+    switch (value)
+    {
+    case Method::Bin: return "bin";
+    case Method::Reassigned: return "reassigned";
+    case Method::Grid: return "grid";
+    case Method::Count: break;
+    }
+    return "unknown";
+  }
+
+  struct Result
+  {
+    const char *signal;
+    int size;
+    Method method;
+    int partials;
+    int missed;
+    // partials too close to another one of their case to be told apart
+    int unresolved;
+    // absolute errors of the found partials, cents
+    float mean;
+    float p95;
+    float max;
+    // analysis of a frame: window, FFT and the weighting or the reassignment
+    double us;
+  };
+
+  auto result(const char *signal,
+              int size,
+              Method method,
+              std::vector<float> &errors,
+              int partials,
+              int unresolved,
+              double us) -> Result
+  {
+    auto res =
+      Result{signal, size, method, partials, partials - static_cast<int>(errors.size()), unresolved, 0, 0, 0, us};
+    if (errors.empty())
+      return res;
+    for (const auto e : errors)
+      res.mean += e / errors.size();
+    res.max = *std::max_element(std::begin(errors), std::end(errors));
+    const auto p95 = std::begin(errors) + std::min(errors.size() * 95 / 100, errors.size() - 1);
+    std::nth_element(std::begin(errors), p95, std::end(errors));
+    res.p95 = *p95;
+    return res;
+  }
+
+  template <typename F>
+  auto timeFrames(F f) -> double
+  {
+    const auto iterations = 100;
+    f(); // warm up
+    const auto t1 = std::chrono::steady_clock::now();
+    for (auto i = 0; i < iterations; ++i)
+      f();
+    const auto t2 = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::micro>(t2 - t1).count() / iterations;
+  }
+
+  // Every resolvable partial is found by the reassignment and by the grid at the smaller sizes,
+  // with the mean and the max error of the strongest bin of the reference size or better. Prints
+  // the failures and returns their number.
+  auto check(const std::vector<Result> &results) -> int
+  {
+    auto res = 0;
+    for (const auto &r : results)
+    {
+      if (r.size >= ReferenceSize || r.method == Method::Bin)
+        continue;
+      const auto ref = std::find_if(std::begin(results), std::end(results), [&r](const Result &x) {
+        return x.size == ReferenceSize && x.method == Method::Bin && strcmp(x.signal, r.signal) == 0;
+      });
+      if (ref == std::end(results))
+        continue;
+      const auto fail = [&](const char *what, float value, float limit) {
+        printf("FAIL %s %d %s: %s %.2f, %d bins %.2f\n",
+               r.signal,
+               r.size,
+               toString(r.method),
+               what,
+               value,
+               ReferenceSize,
+               limit);
+        ++res;
+      };
+      if (r.missed > 0)
+        fail("missed", r.missed, ref->missed);
+      if (r.mean > ref->mean)
+        fail("mean ct", r.mean, ref->mean);
+      if (r.max > ref->max)
+        fail("max ct", r.max, ref->max);
+    }
+    return res;
+  }
+} // namespace
+
+auto accuracyUsage() -> const char *
+{
+  return "[--json <output.json>] [--config <file>] [--<config option> <value>]";
+}
+
+auto accuracy(int argc, const char *argv[]) -> int
+{
+  std::string json;
+  auto cfg = config();
+  for (auto i = 2; i < argc; ++i)
+    if (strcmp(argv[i], "--json") == 0 && i + 1 < argc)
+      json = argv[++i];
+    else if (const auto n = cfg.parse(argv[i], i + 1 < argc ? argv[i + 1] : nullptr))
+      i += n - 1;
+  setConfig(cfg);
+  const auto rate = cfg.sampleFreq;
+  const auto signals = makeSignals();
+
+  std::vector<Result> results;
+  printf("%-9s %6s %-11s %9s %9s %9s %8s %10s %9s %9s\n",
+         "signal",
+         "size",
+         "method",
+         "mean",
+         "p95",
+         "max",
+         "missed",
+         "unresolved",
+         "window",
+         "time");
+  for (const auto size : {4096, 8192, ReferenceSize})
+  {
+    // the FFT view of the live mode next to the reassigned one
+    Stft binStft({size, size, cfg.hopSize, WindowType::ExpDecay});
+    Stft rectStft({size, size, cfg.hopSize, WindowType::Rectangular});
+    const ElcTable elc(Weighting::Elc60, size, rate);
+    const auto params = ReassignmentParams{
+      cfg.startFreq * powf(2.f, -1.f / 12.f), rate / 2.f, ReassignedBinsPerSemitone, size, rate};
+    const Reassignment reassignment(params);
+    const auto gridFreqs = Reassignment::binFreqs(params);
+    const std::vector<float> ones(gridFreqs.size(), 1.f);
+    std::vector<float> grid(gridFreqs.size());
+    std::vector<float> spectr(size / 2);
+    std::vector<int16_t> samples(size);
+    const auto binFreq = 1.f * rate / size;
+
+    synthesize(signals[0].cases.front(), samples);
+    const auto binTime = timeFrames([&]() { elc.apply(binStft.frame(samples.data()), spectr.data(), spectr.size()); });
+    const auto reassignedTime = timeFrames([&]() {
+      reassignment.apply(rectStft.frame(samples.data()), ones.data(), grid.data());
+    });
+
+    for (const auto &signal : signals)
+    {
+      std::vector<float> errors[static_cast<int>(Method::Count)];
+      auto partials = 0;
+      auto unresolved = 0;
+      for (const auto &c : signal.cases)
+      {
+        synthesize(c, samples);
+        const auto *bins = binStft.frame(samples.data());
+        const auto *rect = rectStft.frame(samples.data());
+        reassignment.apply(rect, ones.data(), grid.data());
+        for (const auto &tone : c.tones)
+        {
+          const auto isResolvable = std::all_of(std::begin(c.tones), std::end(c.tones), [&](const Tone &t) {
+            return &t == &tone || std::abs(t.freq - tone.freq) >= ResolvableBins * binFreq;
+          });
+          if (!isResolvable)
+          {
+            ++unresolved;
+            continue;
+          }
+          ++partials;
+          const auto cents = [&](Method m, float freq) {
+            errors[static_cast<int>(m)].push_back(std::abs(1200.f * log2f(freq / tone.freq)));
+          };
+          const auto center = static_cast<int>(lroundf(tone.freq / binFreq));
+          const auto from = std::max(center - SearchBins, 2);
+          const auto to = std::min(center + SearchBins, size / 2 - 2);
+          // the strongest bin is what the FFT view shows
+          auto best = -1;
+          auto bestLevel = 0.f;
+          for (auto k = from; k <= to; ++k)
+            if (const auto level = std::hypot(bins[k][0], bins[k][1]); level > bestLevel)
+            {
+              best = k;
+              bestLevel = level;
+            }
+          if (best >= 0)
+            cents(Method::Bin, best * binFreq);
+          // the partials apply() draws, before and after they snap to the grid
+          auto partial = Partial{0, 0};
+          for (auto k = from; k <= to; ++k)
+            if (Reassignment::isPeak(rect, k))
+              if (const auto p = reassignment.partial(rect, k);
+                  std::abs(p.freq - tone.freq) <= SearchBins * binFreq && p.level > partial.level)
+                partial = p;
+          if (partial.level > 0)
+            cents(Method::Reassigned, partial.freq);
+          // the grid may be coarser than the bins up high, its neighbors of the frequency count too
+          const auto gridFrom = std::max<int>(
+            std::lower_bound(std::begin(gridFreqs), std::end(gridFreqs), tone.freq - SearchBins * binFreq) -
+              std::begin(gridFreqs) - 1,
+            0);
+          const auto gridTo = std::min<int>(
+            std::upper_bound(std::begin(gridFreqs), std::end(gridFreqs), tone.freq + SearchBins * binFreq) -
+              std::begin(gridFreqs) + 1,
+            grid.size());
+          const auto strongest = std::max_element(std::begin(grid) + gridFrom, std::begin(grid) + gridTo);
+          if (strongest != std::begin(grid) + gridTo && *strongest > 0)
+            cents(Method::Grid, gridFreqs[strongest - std::begin(grid)]);
+        }
+      }
+      for (auto m = 0; m < static_cast<int>(Method::Count); ++m)
+      {
+        const auto method = static_cast<Method>(m);
+        const auto res = result(signal.name,
+                                size,
+                                method,
+                                errors[m],
+                                partials,
+                                unresolved,
+                                method == Method::Bin ? binTime : reassignedTime);
+        results.push_back(res);
+        printf("%-9s %6d %-11s %6.2f ct %6.2f ct %6.2f ct %8d %10d %6.0f ms %6.1f us\n",
+               res.signal,
+               res.size,
+               toString(res.method),
+               res.mean,
+               res.p95,
+               res.max,
+               res.missed,
+               res.unresolved,
+               1000.f * size / rate,
+               res.us);
+      }
+    }
+  }
+  const auto failures = check(results);
+  printf("%s\n", failures == 0 ? "ok" : "FAILED");
+
+  if (!json.empty())
+  {
+    auto f = fopen(json.c_str(), "w");
+    if (!f)
+    {
+      LOG("Could not create", json);
+      return 1;
+    }
+    fprintf(f,
+            "{\n  \"sample_rate\": %d,\n  \"grid_bins_per_semitone\": %d,\n  \"failures\": %d,\n  "
+            "\"results\": [",
+            rate,
+            ReassignedBinsPerSemitone,
+            failures);
+    for (auto i = 0U; i < results.size(); ++i)
+    {
+      const auto &r = results[i];
+      fprintf(f,
+              "%s\n    {\"signal\": \"%s\", \"size\": %d, \"method\": \"%s\", \"partials\": %d, "
+              "\"missed\": %d, \"unresolved\": %d, \"mean_cents\": %.3f, \"p95_cents\": %.3f, "
+              "\"max_cents\": %.3f, \"window_ms\": %.1f, \"frame_us\": %.1f}",
+              i == 0 ? "" : ",",
+              r.signal,
+              r.size,
+              toString(r.method),
+              r.partials,
+              r.missed,
+              r.unresolved,
+              r.mean,
+              r.p95,
+              r.max,
+              1000.f * r.size / rate,
+              r.us);
+    }
+    fprintf(f, "\n  ]\n}\n");
+    fclose(f);
+  }
+  return failures == 0 ? 0 : 1;
+}
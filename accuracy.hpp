@@ -0,0 +1,10 @@
+#pragma once
+
+// Pitch accuracy of the FFT peaks against the reassigned partials over a suite of synthetic
+// signals with known frequencies, sines, noisy sines, harmonic tones and triads on every key. Fails
+// unless the reassignment of the smaller FFTs finds every resolvable partial at least as accurately
+// as the strongest bin of the 32768 point one:
+// spectrogram --accuracy [--json <output.json>] [--config <file>] [--<config option> <value>]
+auto accuracy(int argc, const char *argv[]) -> int;
+// the arguments after --accuracy
+auto accuracyUsage() -> const char *;
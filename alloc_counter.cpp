@@ -0,0 +1,51 @@
+#include "alloc_counter.hpp"
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+static std::atomic<unsigned long long> allocationsNum{0};
+static thread_local unsigned long long threadAllocationsNum = 0;
+
+auto allocations() -> unsigned long long
+{
+  return allocationsNum.load(std::memory_order_relaxed);
+}
+
+auto threadAllocations() -> unsigned long long
+{
+  return threadAllocationsNum;
+}
+
+void *operator new(std::size_t size)
+{
+  allocationsNum.fetch_add(1, std::memory_order_relaxed);
+  ++threadAllocationsNum;
+  if (auto p = malloc(size ? size : 1))
+    return p;
+  throw std::bad_alloc{};
+}
+
+void *operator new[](std::size_t size)
+{
+  return operator new(size);
+}
+
+void operator delete(void *p) noexcept
+{
+  free(p);
+}
+
+void operator delete[](void *p) noexcept
+{
+  free(p);
+}
+
+void operator delete(void *p, std::size_t) noexcept
+{
+  free(p);
+}
+
+void operator delete[](void *p, std::size_t) noexcept
+{
+  free(p);
+}
@@ -0,0 +1,24 @@
+#pragma once
+#include <cassert>
+
+// Number of global operator new calls since the start of the program, all threads together
+// (over-aligned allocations are not counted)
+auto allocations() -> unsigned long long;
+// the same for the calling thread only
+auto threadAllocations() -> unsigned long long;
+
+// Counts the allocations of the calling thread over the lifetime of the object. In debug builds a
+// scope marked as steady must not allocate at all.
+class AllocScope
+{
+public:
+  AllocScope(bool isSteady) : isSteady(isSteady), start(threadAllocations()) {}
+  ~AllocScope() { assert((!isSteady || count() == 0) && "allocation in the steady state"); }
+  auto count() const -> unsigned long long { return threadAllocations() - start; }
+  AllocScope(const AllocScope &) = delete;
+  AllocScope &operator=(const AllocScope &) = delete;
+
+private:
+  bool isSteady;
+  unsigned long long start;
+};
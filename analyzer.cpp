@@ -0,0 +1,411 @@
+#include "analyzer.hpp"
+#include "config.hpp"
+#include "consts.hpp"
+#include "profiler.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <functional>
+#include <iterator>
+
+auto toString(Transform value) -> const char *
+{
+  switch (value)
+  {
+  case Transform::Fft: return "FFT";
+  case Transform::Cqt: return "constant-Q";
+  case Transform::Reassigned: return "reassigned";
+  case Transform::MultiResolution: return "multi-resolution";
+  case Transform::Count: break;
+  }
+  return "unknown";
+}
+
+Analyzer::Lane::Lane(StftParams params,
+                     MultiResolutionParams bandsParams,
+                     std::size_t ringSize,
+                     std::size_t maxBins)
+  : ring(ringSize),
+    chunk(ring.capacity()),
+    stft(params),
+    bands(bandsParams),
+    frames(SpectrFrame{std::vector<float>(maxBins), std::vector<float>(PianoKeys)}),
+    events(256)
+{
+}
+
+Analyzer::Analyzer(StftParams params, int lanesNum)
+  : fftWindow(params.window),
+    hopSize(params.hopSize),
+    cqtParams{config().startFreq * powf(2.f, -1.f / 12.f),
+              config().endFreq * powf(2.f, 1.f / 12.f),
+              CqtBinsPerSemitone,
+              params.fftSize,
+              config().sampleFreq},
+    // up to Nyquist, the pitch tracker looks at the harmonics
+    reassignmentParams{cqtParams.minFreq,
+                       config().sampleFreq / 2.f,
+                       ReassignedBinsPerSemitone,
+                       params.fftSize,
+                       config().sampleFreq},
+    cqtFreqs(Cqt::binFreqs(cqtParams)),
+    reassignedFreqs(Reassignment::binFreqs(reassignmentParams)),
+    elc(Weighting::Elc60, params.fftSize, config().sampleFreq)
+{
+  for (auto i = 0; i < params.fftSize / 2; ++i)
+    fftFreqs.push_back(1.f * i * config().sampleFreq / params.fftSize);
+  const auto bandsParams =
+    MultiResolutionParams{cqtParams.minFreq, params.fftSize, params.hopSize, config().sampleFreq};
+  multiResolutionFreqs = MultiResolution::binFreqs(bandsParams);
+  const auto ringSize = 4 * std::max(params.windowSize, config().sampleFreq / 4);
+  // sized for the largest transform, so switching never reallocates
+  const auto maxBins =
+    std::max({fftFreqs.size(), cqtFreqs.size(), reassignedFreqs.size(), multiResolutionFreqs.size()});
+  for (auto i = 0; i < lanesNum; ++i)
+  {
+    lanes.push_back(std::make_unique<Lane>(params, bandsParams, ringSize, maxBins));
+    lanes.back()->norm = SpectralNorm(fftFreqs, 1.f * config().sampleFreq / hopSize);
+    lanes.back()->tracker = PitchTracker(fftFreqs, 1.f * config().sampleFreq / hopSize);
+  }
+  if (!config().shm.empty())
+  {
+    std::vector<std::vector<float>> transformFreqs;
+    for (auto t = 0; t < static_cast<int>(Transform::Count); ++t)
+      transformFreqs.push_back(freqs(static_cast<Transform>(t)));
+    shm = std::make_unique<SharedSpectrumWriter>(config().shm, lanesNum, transformFreqs, config().sampleFreq);
+  }
+  if (lanesNum > 1)
+    pool = std::make_unique<ThreadPool>(
+      std::min(lanesNum, std::max(static_cast<int>(std::thread::hardware_concurrency()), 1)));
+  thread = std::thread([this]() { run(); });
+}
+
+Analyzer::~Analyzer()
+{
+  done = true;
+  thread.join();
+}
+
+auto Analyzer::push(const int16_t *samples, std::size_t size, int firstLane, int channels) -> void
+{
+  if (channels == 1)
+  {
+    auto &lane = *lanes[firstLane];
+    const auto written = lane.ring.push(samples, size);
+    if (written < size)
+      lane.overrunsNum += size - written;
+    return;
+  }
+  // deinterleaved a block at a time on the stack, the audio callback must not allocate
+  const auto frames = size / channels;
+  int16_t block[1024];
+  for (auto c = 0; c < channels && firstLane + c < lanesNum(); ++c)
+  {
+    auto &lane = *lanes[firstLane + c];
+    for (std::size_t f = 0; f < frames; f += std::size(block))
+    {
+      const auto n = std::min(std::size(block), frames - f);
+      for (std::size_t i = 0; i < n; ++i)
+        block[i] = samples[(f + i) * channels + c];
+      const auto written = lane.ring.push(block, n);
+      if (written < n)
+        lane.overrunsNum += n - written;
+    }
+  }
+}
+
+auto Analyzer::update() -> bool
+{
+  auto res = false;
+  for (auto &lane : lanes)
+    res = lane->frames.update() || res;
+  return res;
+}
+
+auto Analyzer::spectr(int lane) const -> const SpectrFrame &
+{
+  return lanes[lane]->frames.front();
+}
+
+auto Analyzer::popNoteEvents(NoteEvent *events, std::size_t size) -> std::size_t
+{
+  auto res = std::size_t{0};
+  for (auto &lane : lanes)
+    res += lane->events.pop(events + res, size - res);
+  return res;
+}
+
+auto Analyzer::setTransform(Transform value) -> void
+{
+  newTransform = value;
+}
+
+auto Analyzer::transform() const -> Transform
+{
+  return newTransform;
+}
+
+auto Analyzer::freqs(Transform value) const -> const std::vector<float> &
+{
+  switch (value)
+  {
+  case Transform::Cqt: return cqtFreqs;
+  case Transform::Reassigned: return reassignedFreqs;
+  case Transform::MultiResolution: return multiResolutionFreqs;
+  case Transform::Fft:
+  case Transform::Count: break;
+  }
+  return fftFreqs;
+}
+
+auto Analyzer::setWeighting(Weighting value) -> void
+{
+  newWeighting = value;
+}
+
+auto Analyzer::weighting() const -> Weighting
+{
+  return newWeighting;
+}
+
+auto Analyzer::setEnvelope(Envelope value) -> void
+{
+  newEnvelope = value;
+}
+
+auto Analyzer::envelope() const -> Envelope
+{
+  return newEnvelope;
+}
+
+auto Analyzer::startRecording(const std::string &path) -> void
+{
+  recorderTransform = transform();
+  std::atomic_store(&recorder, std::make_shared<Recorder>(path, freqs(recorderTransform)));
+}
+
+auto Analyzer::stopRecording() -> void
+{
+  std::atomic_store(&recorder, std::shared_ptr<Recorder>{});
+}
+
+auto Analyzer::isRecording() const -> bool
+{
+  return std::atomic_load(&recorder) != nullptr;
+}
+
+auto Analyzer::underruns() const -> unsigned long long
+{
+  return underrunsNum;
+}
+
+auto Analyzer::overruns() const -> unsigned long long
+{
+  auto res = 0ULL;
+  for (const auto &lane : lanes)
+    res += lane->overrunsNum;
+  return res;
+}
+
+auto Analyzer::frameTime() const -> float
+{
+  return frameTimeUs;
+}
+
+auto Analyzer::peak() const -> int
+{
+  return peakLevel;
+}
+
+auto Analyzer::droppedFrames() const -> unsigned long long
+{
+  auto res = 0ULL;
+  for (const auto &lane : lanes)
+    res += lane->frames.dropped();
+  return res;
+}
+
+auto Analyzer::repeatedFrames() const -> unsigned long long
+{
+  auto res = 0ULL;
+  for (const auto &lane : lanes)
+    res += lane->frames.repeated();
+  return res;
+}
+
+auto Analyzer::run() -> void
+{
+  // the sections of a frame in their order, the workers of the pool take their rings with their
+  // first sample
+  for (const auto name : {"decimation", "window", "fft", "weighting", "pitch", "publish", "normalization"})
+    Profiler::instance().reserve(name);
+  const auto period = std::chrono::microseconds(1'000'000LL * hopSize / config().sampleFreq);
+  const std::function<void(int64_t, int64_t, int)> tickLanes = [this](int64_t begin, int64_t end, int) {
+    for (auto i = begin; i < end; ++i)
+      tick(i);
+  };
+  auto next = std::chrono::steady_clock::now();
+  while (!done)
+  {
+    next += period;
+    std::this_thread::sleep_until(next);
+    applyChanges();
+    const auto t1 = std::chrono::steady_clock::now();
+    if (pool)
+      pool->parallelFor(0, lanesNum(), 1, tickLanes);
+    else
+      tick(0);
+    const auto t2 = std::chrono::steady_clock::now();
+    auto peak = -1;
+    auto analyzed = 0;
+    for (const auto &lane : lanes)
+    {
+      peak = std::max(peak, lane->peak);
+      analyzed = std::max(analyzed, lane->analyzed);
+    }
+    if (peak < 0)
+    {
+      ++underrunsNum;
+      peakLevel = 0;
+      continue;
+    }
+    peakLevel = peak;
+    if (analyzed > 0)
+      frameTimeUs =
+        frameTimeUs +
+        0.05f * (std::chrono::duration<float, std::micro>(t2 - t1).count() / analyzed - frameTimeUs);
+    // do not try to catch up if the analysis fell behind, just skip the missed ticks
+    const auto now = std::chrono::steady_clock::now();
+    if (next < now)
+      next = now;
+  }
+}
+
+// the settings shared by the lanes change between the ticks, while no lane runs
+auto Analyzer::applyChanges() -> void
+{
+  if (currentTransform != newTransform)
+  {
+    // only one of the stft and the bands gets the samples, the other one starts over with silence
+    // rather than with the sound from before
+    if (currentTransform == Transform::MultiResolution || newTransform == Transform::MultiResolution)
+      for (auto &lane : lanes)
+      {
+        lane->stft.reset();
+        lane->bands.reset();
+      }
+    currentTransform = newTransform;
+    for (auto &lane : lanes)
+    {
+      // the constant-Q and reassignment kernels carry their own windows
+      lane->stft.setWindow(currentTransform == Transform::Fft ? fftWindow : WindowType::Rectangular);
+      lane->norm = SpectralNorm(freqs(currentTransform), 1.f * config().sampleFreq / hopSize);
+    }
+    // the sounding notes end with the old bins
+    for (auto i = 0; i < lanesNum(); ++i)
+    {
+      lanes[i]->tracker.reset();
+      pushNoteEvents(i);
+      lanes[i]->tracker = PitchTracker(freqs(currentTransform), 1.f * config().sampleFreq / hopSize);
+    }
+    if (currentTransform == Transform::Cqt && !cqt)
+      cqt = std::make_unique<Cqt>(cqtParams);
+    if (currentTransform == Transform::Reassigned && !reassignment)
+      reassignment = std::make_unique<Reassignment>(reassignmentParams);
+    elc = ElcTable(newWeighting, freqs(currentTransform));
+  }
+  if (elc.weighting() != newWeighting)
+    elc = ElcTable(newWeighting, freqs(currentTransform));
+}
+
+// drains the ring buffer of the lane, peak is -1 if it was empty
+auto Analyzer::tick(int idx) -> void
+{
+  auto &lane = *lanes[idx];
+  lane.analyzed = 0;
+  const auto n = lane.ring.pop(lane.chunk.data(), lane.chunk.size());
+  if (n == 0)
+  {
+    lane.peak = -1;
+    return;
+  }
+  auto peak = 0;
+  for (size_t i = 0; i < n; ++i)
+    peak = std::max(peak, std::abs(static_cast<int>(lane.chunk[i])));
+  lane.peak = peak;
+  if (currentTransform == Transform::MultiResolution)
+    lane.bands.push(lane.chunk.data(), n, [this, idx, &lane]() {
+      analyze(idx, nullptr);
+      ++lane.analyzed;
+    });
+  else
+    lane.stft.push(lane.chunk.data(), n, [this, idx, &lane](const fftwf_complex *bins) {
+      analyze(idx, bins);
+      ++lane.analyzed;
+    });
+}
+
+// bins is null with the multi-resolution transform, the bands keep their own
+auto Analyzer::analyze(int idx, const fftwf_complex *bins) -> void
+{
+  auto &lane = *lanes[idx];
+  auto &frame = lane.frames.back();
+  frame.spectr.resize(freqs(currentTransform).size());
+  {
+    ScopedTimer timer("weighting");
+    if (currentTransform == Transform::Cqt)
+      cqt->apply(bins, elc.data(), frame.spectr.data());
+    else if (currentTransform == Transform::Reassigned)
+      reassignment->apply(bins, elc.data(), frame.spectr.data());
+    else if (currentTransform == Transform::MultiResolution)
+      lane.bands.apply(elc.data(), frame.spectr.data());
+    else
+      elc.apply(bins, frame.spectr.data(), frame.spectr.size());
+  }
+  frame.transform = currentTransform;
+  ++lane.framesNum;
+  if (idx == 0)
+  {
+    if (const auto r = std::atomic_load(&recorder); r && recorderTransform == currentTransform)
+      r->push(frame.spectr.data(), 1. * lane.framesNum * hopSize / config().sampleFreq);
+  }
+  {
+    ScopedTimer timer("pitch");
+    lane.tracker.apply(frame.spectr.data(), elc.data());
+  }
+  std::copy(std::begin(lane.tracker.notes()), std::end(lane.tracker.notes()), std::begin(frame.notes));
+  pushNoteEvents(idx);
+  if (shm)
+  {
+    ScopedTimer timer("publish");
+    shm->publish(idx,
+                 1. * lane.framesNum * hopSize / config().sampleFreq,
+                 static_cast<int>(currentTransform),
+                 frame.spectr.data(),
+                 frame.spectr.size(),
+                 frame.notes.data());
+  }
+  frame.envelope = newEnvelope;
+  {
+    ScopedTimer timer("normalization");
+    lane.norm.apply(frame.spectr.data(), frame.spectr.data(), frame.envelope);
+  }
+  lane.frames.publish();
+}
+
+auto Analyzer::pushNoteEvents(int idx) -> void
+{
+  auto &lane = *lanes[idx];
+  const auto time = 1.f * lane.framesNum * hopSize / config().sampleFreq;
+  for (const auto key : lane.tracker.changes())
+  {
+    const auto c = lane.tracker.notes()[key];
+    const auto e = NoteEvent{time,
+                             static_cast<uint8_t>(idx),
+                             static_cast<uint8_t>(key),
+                             static_cast<uint8_t>(lroundf(c * 255)),
+                             c > 0};
+    lane.events.push(&e, 1);
+  }
+}
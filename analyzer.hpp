@@ -0,0 +1,140 @@
+#pragma once
+#include "cqt.hpp"
+#include "elc.hpp"
+#include "multi_resolution.hpp"
+#include "pitch_tracker.hpp"
+#include "reassignment.hpp"
+#include "recording.hpp"
+#include "ring_buffer.hpp"
+#include "shared_spectrum.hpp"
+#include "spectral_norm.hpp"
+#include "stft.hpp"
+#include "thread_pool.hpp"
+#include "triple_buffer.hpp"
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+enum class Transform { Fft, Cqt, Reassigned, MultiResolution, Count };
+
+auto toString(Transform) -> const char *;
+
+// normalized to 0..1 for the display
+struct SpectrFrame
+{
+  std::vector<float> spectr;
+  // PianoKeys confidences of the sounding notes, 0 for the silent keys
+  std::vector<float> notes;
+  Transform transform = Transform::Fft;
+  Envelope envelope = Envelope::None;
+};
+
+// Owns the STFT of every captured channel and runs them on a dedicated thread. The audio callbacks
+// only push samples into lock-free ring buffers, the analysis thread drains them every hop worth of
+// time and publishes the latest spectra through triple buffers, so the renderer and the analysis
+// never wait on each other. Each channel is a lane with its own buffers; the lanes of a tick run in
+// parallel on a thread pool and share the read-only FFT plan, weighting and the constant-Q and
+// reassignment kernels.
+class Analyzer
+{
+public:
+  Analyzer(StftParams, int lanes = 1);
+  ~Analyzer();
+  auto lanesNum() const -> int { return static_cast<int>(lanes.size()); }
+  // samples of channels interleaved channels, the first one goes to firstLane; one producer per lane
+  auto push(const int16_t *samples, std::size_t size, int firstLane = 0, int channels = 1) -> void;
+  // picks up the latest complete frames of all the lanes, returns false if nothing new was published
+  auto update() -> bool;
+  // the frame picked up by the last update(), valid until the next one
+  auto spectr(int lane = 0) const -> const SpectrFrame &;
+  // notes which started or stopped since the last call, one consumer; returns the number of events
+  auto popNoteEvents(NoteEvent *events, std::size_t size) -> std::size_t;
+  // the constant-Q and reassignment kernels are built on the analysis thread the first time they
+  // are needed
+  auto setTransform(Transform) -> void;
+  auto transform() const -> Transform;
+  // frequencies of the bins the given transform produces
+  auto freqs(Transform) const -> const std::vector<float> &;
+  // the gain table is rebuilt on the analysis thread
+  auto setWeighting(Weighting) -> void;
+  auto weighting() const -> Weighting;
+  // smart scale estimator of the published frames, the recordings keep the weighted spectrum
+  auto setEnvelope(Envelope) -> void;
+  auto envelope() const -> Envelope;
+  // records every analyzed frame of the first lane in the current transform until stopRecording()
+  auto startRecording(const std::string &path) -> void;
+  auto stopRecording() -> void;
+  auto isRecording() const -> bool;
+  // analysis ticks which found no new samples in any ring buffer
+  auto underruns() const -> unsigned long long;
+  // samples dropped by the capture callbacks because a ring buffer was full
+  auto overruns() const -> unsigned long long;
+  // moving average of the analysis time of a frame of all the lanes (window, FFT, weighting, pitch
+  // tracking and normalization) in microseconds
+  auto frameTime() const -> float;
+  // largest absolute sample value of the last analysis tick over all the lanes, 0 if no samples
+  // arrived
+  auto peak() const -> int;
+  // frames the renderer never saw and render ticks which found no new frame, all the lanes together
+  auto droppedFrames() const -> unsigned long long;
+  auto repeatedFrames() const -> unsigned long long;
+
+private:
+  struct Lane
+  {
+    Lane(StftParams, MultiResolutionParams, std::size_t ringSize, std::size_t maxBins);
+    RingBuffer<int16_t> ring;
+    std::vector<int16_t> chunk;
+    Stft stft;
+    // takes the samples instead of stft with the multi-resolution transform
+    MultiResolution bands;
+    SpectralNorm norm;
+    PitchTracker tracker;
+    TripleBuffer<SpectrFrame> frames;
+    // note changes on the way to popNoteEvents(), dropped if nobody reads them
+    RingBuffer<NoteEvent> events;
+    long long framesNum = 0;
+    std::atomic<unsigned long long> overrunsNum{0};
+    // results of the current tick
+    int peak = 0;
+    int analyzed = 0;
+  };
+
+  auto run() -> void;
+  auto applyChanges() -> void;
+  auto tick(int lane) -> void;
+  auto analyze(int lane, const fftwf_complex *bins) -> void;
+  auto pushNoteEvents(int lane) -> void;
+
+  WindowType fftWindow;
+  int hopSize;
+  CqtParams cqtParams;
+  ReassignmentParams reassignmentParams;
+  std::vector<float> fftFreqs;
+  std::vector<float> cqtFreqs;
+  std::vector<float> reassignedFreqs;
+  std::vector<float> multiResolutionFreqs;
+  std::vector<std::unique_ptr<Lane>> lanes;
+  // only with more than one lane
+  std::unique_ptr<ThreadPool> pool;
+  std::unique_ptr<Cqt> cqt;
+  std::unique_ptr<Reassignment> reassignment;
+  Transform currentTransform = Transform::Fft;
+  std::atomic<Transform> newTransform{Transform::Fft};
+  ElcTable elc;
+  std::atomic<Weighting> newWeighting{Weighting::Elc60};
+  std::atomic<Envelope> newEnvelope{Envelope::None};
+  // accessed with std::atomic_load/store
+  std::shared_ptr<Recorder> recorder;
+  std::atomic<Transform> recorderTransform{Transform::Fft};
+  // every lane before the normalization, only if the shm option is set
+  std::unique_ptr<SharedSpectrumWriter> shm;
+  std::atomic<unsigned long long> underrunsNum{0};
+  std::atomic<float> frameTimeUs{0};
+  std::atomic<int> peakLevel{0};
+  std::atomic<bool> done{false};
+  std::thread thread;
+};
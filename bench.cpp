@@ -0,0 +1,435 @@
+#include "bench.hpp"
+#include "alloc_counter.hpp"
+#include "config.hpp"
+#include "elc.hpp"
+#include "gaussian_elimination.hpp"
+#include "multi_resolution.hpp"
+#include "pitch_tracker.hpp"
+#include "simd.hpp"
+#include "spectral_norm.hpp"
+#include "stft.hpp"
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <log/log.hpp>
+#include <random>
+#include <string>
+#include <tuple>
+#include <vector>
+
+namespace
+{
+  // the vector of rows solver the contiguous one replaced, kept for the comparison
+  using LegacyMatrix = std::vector<std::vector<float>>;
+
+  auto legacySolve(LegacyMatrix eqns) -> std::vector<float>
+  {
+    const int rows = eqns.size(), cols = eqns[0].size();
+    for (int i = 0; i < rows - 1; i++)
+    {
+      int pivot = i;
+      for (int j = i + 1; j < rows; j++)
+        if (std::abs(eqns[j][i]) > std::abs(eqns[pivot][i]))
+          pivot = j;
+      if (eqns[pivot][i] == 0.0)
+        continue;
+      if (i != pivot)
+        std::swap(eqns[pivot], eqns[i]);
+      for (int j = i + 1; j < rows; j++)
+      {
+        float scale = eqns[j][i] / eqns[i][i];
+        for (int k = i + 1; k < cols; k++)
+          eqns[j][k] -= scale * eqns[i][k];
+        eqns[j][i] = 0.0;
+      }
+    }
+    std::vector<float> ans(rows);
+    for (int i = rows - 1; i >= 0; i--)
+    {
+      float sum = 0.0;
+      for (int j = i + 1; j < rows; j++)
+        sum += eqns[i][j] * ans[j];
+      if (eqns[i][i] == 0)
+        return {};
+      ans[i] = (eqns[i][rows] - sum) / eqns[i][i];
+    }
+    return ans;
+  }
+
+  // count random symmetric positive definite systems of n unknowns, like the normal equations of
+  // the envelope fits
+  auto randomSystems(std::mt19937 &gen, int n, int count) -> std::vector<LegacyMatrix>
+  {
+    std::uniform_real_distribution<float> dist(-1.f, 1.f);
+    std::vector<LegacyMatrix> res;
+    for (auto s = 0; s < count; ++s)
+    {
+      LegacyMatrix m(n, std::vector<float>(n));
+      for (auto &row : m)
+        for (auto &v : row)
+          v = dist(gen);
+      LegacyMatrix a(n, std::vector<float>(n + 1));
+      for (auto i = 0; i < n; ++i)
+      {
+        for (auto j = 0; j < n; ++j)
+          for (auto k = 0; k < n; ++k)
+            a[i][j] += m[k][i] * m[k][j];
+        a[i][i] += 1;
+        a[i][n] = dist(gen);
+      }
+      res.push_back(std::move(a));
+    }
+    return res;
+  }
+} // namespace
+
+template <typename F>
+static auto measure(const char *name, const char *isa, F f) -> void
+{
+  const auto iterations = 200;
+  f(); // warm up
+  const auto t1 = std::chrono::steady_clock::now();
+  for (auto i = 0; i < iterations; ++i)
+    f();
+  const auto t2 = std::chrono::steady_clock::now();
+  printf("%-12s %-8s %10.0f ns/frame\n",
+         name,
+         isa,
+         std::chrono::duration<double, std::nano>(t2 - t1).count() / iterations);
+}
+
+auto benchKernels() -> int
+{
+  const auto spectrSize = config().spectrSize;
+  std::mt19937 gen(42);
+  std::uniform_int_distribution<int> sampleDist(-0x8000, 0x7fff);
+  std::normal_distribution<float> binDist(0.f, 1000.f);
+
+  std::vector<int16_t> ring(spectrSize);
+  for (auto &s : ring)
+    s = sampleDist(gen);
+  std::vector<float> bins(spectrSize + 2);
+  for (auto &b : bins)
+    b = binDist(gen);
+  const auto complexBins = reinterpret_cast<const fftwf_complex *>(bins.data());
+  std::vector<float> window(spectrSize);
+  for (auto i = 0; i < spectrSize; ++i)
+    window[i] = expf(-0.00025f * (spectrSize - i));
+  ElcTable elc(Weighting::Elc60, spectrSize, config().sampleFreq);
+  std::vector<float> gains(spectrSize / 2);
+  for (auto i = 0U; i < gains.size(); ++i)
+    gains[i] = elc[i];
+  std::vector<float> input(spectrSize);
+  std::vector<float> out(spectrSize / 2);
+  const auto pos = spectrSize / 3;
+  std::vector<float> freqs(spectrSize / 2);
+  for (auto i = 0U; i < freqs.size(); ++i)
+    freqs[i] = 1.f * i * config().sampleFreq / spectrSize;
+  SpectralNorm norm(freqs);
+  std::vector<float> spectr(freqs.size());
+  Simd::magnitude(complexBins, gains.data(), spectr.data(), spectr.size());
+
+  // the solvers on the same systems, a set of small ones and a set of larger ones
+  struct SolverCase
+  {
+    std::string name;
+    std::vector<LegacyMatrix> systems;
+    std::vector<Matrix> matrices;
+    GaussianElimination::Batch batch;
+  };
+  std::vector<SolverCase> solverCases;
+  for (const auto &[name, n, count] : {std::tuple{"3x64", 3, 64}, std::tuple{"8x16", 8, 16}})
+  {
+    auto &c = solverCases.emplace_back(SolverCase{name, randomSystems(gen, n, count), {}, {n, count}});
+    c.matrices.resize(count, Matrix(n, n + 1));
+  }
+  // copies the systems in, the solvers work in place
+  const auto load = [](SolverCase &c, bool isBatch) {
+    const auto n = c.batch.size();
+    for (auto s = 0; s < c.batch.count(); ++s)
+      for (auto r = 0; r < n; ++r)
+        for (auto col = 0; col <= n; ++col)
+          if (isBatch)
+            c.batch.at(r, col)[s] = c.systems[s][r][col];
+          else
+            c.matrices[s](r, col) = c.systems[s][r][col];
+  };
+
+  // the original per-callback code
+  measure("window", "original", [&]() {
+    for (auto i = 0; i < spectrSize; ++i)
+      input[i] = expf(-0.00025f * (spectrSize - i)) * ring[(pos + i) % ring.size()];
+  });
+  measure("magnitude", "original", [&]() {
+    std::vector<float> spectr;
+    for (auto j = 0; j < spectrSize / 2; ++j)
+      spectr.push_back(elcK(j * config().sampleFreq / spectrSize) *
+                       sqrt(bins[2 * j] * bins[2 * j] + bins[2 * j + 1] * bins[2 * j + 1]));
+  });
+  // and the original solver, it copies every system
+  for (auto &c : solverCases)
+    measure(("solve " + c.name).c_str(), "original", [&]() {
+      for (const auto &system : c.systems)
+        legacySolve(system);
+    });
+
+  const auto best = Simd::isa();
+  for (auto isa : {Simd::Isa::Scalar, Simd::Isa::Sse2, Simd::Isa::Avx2})
+  {
+    Simd::setIsa(isa);
+    if (Simd::isa() != isa)
+      continue;
+    measure("window", Simd::toString(isa), [&]() {
+      Simd::windowRing(ring.data(), ring.size(), pos, window.data(), input.data());
+    });
+    measure("magnitude", Simd::toString(isa), [&]() {
+      Simd::magnitude(complexBins, gains.data(), out.data(), out.size());
+    });
+    measure("power", Simd::toString(isa), [&]() {
+      Simd::power(complexBins, out.data(), out.size());
+    });
+    for (auto &c : solverCases)
+    {
+      measure(("solve " + c.name).c_str(), Simd::toString(isa), [&]() {
+        load(c, false);
+        for (auto &m : c.matrices)
+          GaussianElimination::solve(m);
+      });
+      measure(("batch " + c.name).c_str(), Simd::toString(isa), [&]() {
+        load(c, true);
+        c.batch.solve();
+      });
+    }
+    // the smart scale estimators, min-track keeps its floor between the iterations like it does
+    // between the frames
+    for (auto i = 0; i < static_cast<int>(Envelope::Count); ++i)
+    {
+      const auto envelope = static_cast<Envelope>(i);
+      measure(toString(envelope), Simd::toString(isa), [&]() {
+        norm.apply(spectr.data(), out.data(), envelope);
+      });
+    }
+  }
+  Simd::setIsa(best);
+  return 0;
+}
+
+namespace
+{
+  // deterministic test signals, size samples at the configured sample rate
+  auto sine(int size) -> std::vector<int16_t>
+  {
+    std::vector<int16_t> res(size);
+    for (auto i = 0; i < size; ++i)
+      res[i] = static_cast<int16_t>(0x4000 * sin(2 * M_PI * 440 * i / config().sampleFreq));
+    return res;
+  }
+
+  // exponential sweep over the displayed range, one octave per second
+  auto chirp(int size) -> std::vector<int16_t>
+  {
+    std::vector<int16_t> res(size);
+    double phase = 0;
+    for (auto i = 0; i < size; ++i)
+    {
+      const auto freq = config().startFreq * pow(2., fmod(1. * i / config().sampleFreq, log2(1. * config().endFreq / config().startFreq)));
+      phase += 2 * M_PI * freq / config().sampleFreq;
+      res[i] = static_cast<int16_t>(0x4000 * sin(phase));
+    }
+    return res;
+  }
+
+  auto noise(int size) -> std::vector<int16_t>
+  {
+    std::mt19937 gen(42);
+    std::uniform_int_distribution<int> dist(-0x4000, 0x3fff);
+    std::vector<int16_t> res(size);
+    for (auto &s : res)
+      s = dist(gen);
+    return res;
+  }
+
+  // the same as the keyboard synthesizer of the live mode
+  auto square(int size) -> std::vector<int16_t>
+  {
+    std::vector<int16_t> res(size);
+    double pos = 0;
+    for (auto i = 0; i < size; ++i)
+    {
+      pos += 1.f * 440 * 2 * 3.1415926 / config().sampleFreq;
+      res[i] = static_cast<int16_t>(0.05f * 0x8000 * (sin(pos) > 0 ? 1 : -1));
+    }
+    return res;
+  }
+
+  struct Result
+  {
+    const char *signal;
+    const char *transform;
+    int size;
+    int frames;
+    double stft;
+    double weighting;
+    double pitch;
+    double norm;
+    double allocs;
+  };
+} // namespace
+
+auto benchUsage() -> const char *
+{
+  return "[--json <output.json>] [--frames <n>] [--envelope <off|iir|cepstral|min-track|poly>] [--config <file>] "
+         "[--<config option> <value>]";
+}
+
+auto bench(int argc, const char *argv[]) -> int
+{
+  std::string json;
+  auto frames = 1000;
+  auto envelope = Envelope::Iir;
+  auto cfg = config();
+  for (auto i = 2; i < argc; ++i)
+    if (strcmp(argv[i], "--json") == 0 && i + 1 < argc)
+      json = argv[++i];
+    else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc)
+      frames = std::stoi(argv[++i]);
+    else if (strcmp(argv[i], "--envelope") == 0 && i + 1 < argc)
+      envelope = toEnvelope(argv[++i]);
+    else if (const auto n = cfg.parse(argv[i], i + 1 < argc ? argv[i + 1] : nullptr))
+      i += n - 1;
+  setConfig(cfg);
+
+  using Generator = std::vector<int16_t> (*)(int);
+  const std::pair<const char *, Generator> signals[] = {
+    {"sine", sine}, {"chirp", chirp}, {"noise", noise}, {"square", square}};
+  std::vector<Result> results;
+  printf("%-8s %-9s %6s %12s %12s %12s %12s %12s %10s\n",
+         "signal",
+         "transform",
+         "size",
+         "stft",
+         "weighting",
+         "pitch",
+         "norm",
+         "total",
+         "allocs");
+  for (const auto size : {1024, 2048, 4096, 8192, 16384, 32768, 65536})
+    for (const auto isMultiResolution : {false, true})
+    {
+      // the live pipeline: STFT or the octave bands of the same resolution, ELC weighting, pitch
+      // tracking, smart scale
+      Stft stft({size, size, config().hopSize, WindowType::ExpDecay});
+      const auto bandsParams =
+        MultiResolutionParams{config().startFreq * powf(2.f, -1.f / 12.f), size, config().hopSize, config().sampleFreq};
+      MultiResolution bands(bandsParams);
+      std::vector<float> freqs;
+      if (isMultiResolution)
+        freqs = MultiResolution::binFreqs(bandsParams);
+      else
+        for (auto i = 0; i < size / 2; ++i)
+          freqs.push_back(1.f * i * config().sampleFreq / size);
+      const auto elc = isMultiResolution ? ElcTable(Weighting::Elc60, freqs)
+                                         : ElcTable(Weighting::Elc60, size, config().sampleFreq);
+      PitchTracker tracker(freqs);
+      SpectralNorm norm(freqs);
+      std::vector<float> spectr(freqs.size());
+      std::vector<float> ys(freqs.size());
+
+      for (const auto &signal : signals)
+      {
+        const auto samples = signal.second(size + frames * config().hopSize);
+        // fill the history first
+        if (isMultiResolution)
+          bands.push(samples.data(), size, []() {});
+        else
+          stft.push(samples.data(), size, [](const fftwf_complex *) {});
+
+        auto weightingTime = std::chrono::steady_clock::duration{};
+        auto pitchTime = std::chrono::steady_clock::duration{};
+        auto normTime = std::chrono::steady_clock::duration{};
+        const auto analyze = [&](const fftwf_complex *bins) {
+          const auto t1 = std::chrono::steady_clock::now();
+          if (bins)
+            elc.apply(bins, spectr.data(), spectr.size());
+          else
+            bands.apply(elc.data(), spectr.data());
+          const auto t2 = std::chrono::steady_clock::now();
+          tracker.apply(spectr.data(), elc.data());
+          const auto t3 = std::chrono::steady_clock::now();
+          norm.apply(spectr.data(), ys.data(), envelope);
+          const auto t4 = std::chrono::steady_clock::now();
+          weightingTime += t2 - t1;
+          pitchTime += t3 - t2;
+          normTime += t4 - t3;
+        };
+        const auto allocs = allocations();
+        const auto t1 = std::chrono::steady_clock::now();
+        if (isMultiResolution)
+          bands.push(samples.data() + size, frames * config().hopSize, [&]() { analyze(nullptr); });
+        else
+          stft.push(samples.data() + size, frames * config().hopSize, analyze);
+        const auto t2 = std::chrono::steady_clock::now();
+        const auto ns = [frames](std::chrono::steady_clock::duration d) {
+          return std::chrono::duration<double, std::nano>(d).count() / frames;
+        };
+        const auto res = Result{signal.first,
+                                isMultiResolution ? "bands" : "fft",
+                                size,
+                                frames,
+                                ns(t2 - t1 - weightingTime - pitchTime - normTime),
+                                ns(weightingTime),
+                                ns(pitchTime),
+                                ns(normTime),
+                                1. * (allocations() - allocs) / frames};
+        results.push_back(res);
+        printf("%-8s %-9s %6d %9.0f ns %9.0f ns %9.0f ns %9.0f ns %9.0f ns %10.2f\n",
+               res.signal,
+               res.transform,
+               res.size,
+               res.stft,
+               res.weighting,
+               res.pitch,
+               res.norm,
+               res.stft + res.weighting + res.pitch + res.norm,
+               res.allocs);
+      }
+    }
+
+  if (!json.empty())
+  {
+    auto f = fopen(json.c_str(), "w");
+    if (!f)
+    {
+      LOG("Could not create", json);
+      return 1;
+    }
+    fprintf(f,
+            "{\n  \"isa\": \"%s\",\n  \"hop\": %d,\n  \"envelope\": \"%s\",\n  \"results\": [",
+            Simd::toString(Simd::isa()),
+            config().hopSize,
+            toString(envelope));
+    for (auto i = 0U; i < results.size(); ++i)
+    {
+      const auto &r = results[i];
+      fprintf(f,
+              "%s\n    {\"signal\": \"%s\", \"transform\": \"%s\", \"size\": %d, \"frames\": %d, \"stft_ns\": %.1f, "
+              "\"weighting_ns\": %.1f, \"pitch_ns\": %.1f, \"norm_ns\": %.1f, \"total_ns\": %.1f, "
+              "\"allocs_per_frame\": %g}",
+              i == 0 ? "" : ",",
+              r.signal,
+              r.transform,
+              r.size,
+              r.frames,
+              r.stft,
+              r.weighting,
+              r.pitch,
+              r.norm,
+              r.stft + r.weighting + r.pitch + r.norm,
+              r.allocs);
+    }
+    fprintf(f, "\n  ]\n}\n");
+    fclose(f);
+  }
+  return 0;
+}
@@ -0,0 +1,12 @@
+#pragma once
+
+// Microbenchmark of the capture pipeline kernels, compares the SIMD paths with the scalar one
+auto benchKernels() -> int;
+
+// Analysis pipeline benchmark over synthetic signals and a range of FFT sizes, each one as a single
+// FFT and as the octave bands of the same resolution:
+// spectrogram --bench [--json <output.json>] [--frames <n>] [--envelope <off|iir|cepstral|min-track|poly>]
+// [--config <file>] [--<config option> <value>]
+auto bench(int argc, const char *argv[]) -> int;
+// the arguments after --bench
+auto benchUsage() -> const char *;
@@ -0,0 +1,156 @@
+#include "config.hpp"
+#include "stft.hpp"
+#include <algorithm>
+#include <fstream>
+#include <log/log.hpp>
+
+static auto current() -> Config &
+{
+  static Config config;
+  return config;
+}
+
+auto config() -> const Config &
+{
+  return current();
+}
+
+auto setConfig(const Config &value) -> void
+{
+  value.validate();
+  current() = value;
+}
+
+auto Config::load(const std::string &path) -> void
+{
+  std::ifstream f(path);
+  if (!f)
+  {
+    LOG("Could not open", path);
+    throw -22;
+  }
+  std::string line;
+  auto lineNum = 0;
+  while (std::getline(f, line))
+  {
+    ++lineNum;
+    line = line.substr(0, line.find('#'));
+    const auto eq = line.find('=');
+    const auto trim = [](std::string s) {
+      s.erase(0, s.find_first_not_of(" \t\r"));
+      s.erase(s.find_last_not_of(" \t\r") + 1);
+      return s;
+    };
+    if (trim(line).empty())
+      continue;
+    if (eq == std::string::npos || !set(trim(line.substr(0, eq)), trim(line.substr(eq + 1))))
+    {
+      LOG(path + ":" + std::to_string(lineNum) + ":", "unknown option", line);
+      throw -22;
+    }
+  }
+}
+
+auto Config::set(const std::string &key, const std::string &value) -> bool
+{
+  try
+  {
+    if (key == "start-freq")
+      startFreq = std::stof(value);
+    else if (key == "end-freq")
+      endFreq = std::stof(value);
+    else if (key == "width")
+      width = std::stoi(value);
+    else if (key == "height")
+      height = std::stoi(value);
+    else if (key == "fft-size")
+      spectrSize = std::stoi(value);
+    else if (key == "sample-rate")
+      sampleFreq = std::stoi(value);
+    else if (key == "hop-size")
+      hopSize = std::stoi(value);
+    else if (key == "window")
+    {
+      toWindowType(value);
+      window = value;
+    }
+    else if (key == "window-size")
+      windowSize = std::stoi(value);
+    else if (key == "channels")
+      channels = std::stoi(value);
+    else if (key == "capture-devices")
+    {
+      devices.clear();
+      std::string::size_type begin = 0;
+      while (begin <= value.size())
+      {
+        const auto end = std::min(value.find(',', begin), value.size());
+        auto name = value.substr(begin, end - begin);
+        name.erase(0, name.find_first_not_of(' '));
+        name.erase(name.find_last_not_of(' ') + 1);
+        if (!name.empty())
+          devices.push_back(name);
+        begin = end + 1;
+      }
+    }
+    else if (key == "note-events")
+      noteEvents = value;
+    else if (key == "shm")
+      shm = value;
+    else
+      return false;
+  }
+  catch (const std::logic_error &)
+  {
+    LOG("Invalid value of", key, value);
+    throw -22;
+  }
+  return true;
+}
+
+auto Config::parse(const char *name, const char *value) -> int
+{
+  const std::string arg = name;
+  if (arg.compare(0, 2, "--") != 0 || !value)
+    return 0;
+  if (arg == "--config")
+    load(value);
+  else if (!set(arg.substr(2), value))
+    return 0;
+  return 2;
+}
+
+auto Config::validate() const -> void
+{
+  if (!(startFreq > 0 && startFreq < endFreq && endFreq < sampleFreq / 2.f))
+  {
+    LOG("Invalid frequency range", startFreq, endFreq);
+    throw -23;
+  }
+  if (width < 60 || height < 4)
+  {
+    LOG("Invalid window size", width, height);
+    throw -23;
+  }
+  if (spectrSize < 64 || spectrSize % 2 != 0 || hopSize <= 0 || hopSize > spectrSize)
+  {
+    LOG("Invalid FFT size", spectrSize, "or hop size", hopSize);
+    throw -23;
+  }
+  // a hop longer than the window would skip samples
+  if (windowSize < 0 || windowSize > spectrSize || hopSize > stftParams().windowSize)
+  {
+    LOG("Invalid window size", windowSize, "of FFT size", spectrSize, "and hop size", hopSize);
+    throw -23;
+  }
+  if (channels < 1 || channels > 8 || channels * std::max<int>(devices.size(), 1) > 32)
+  {
+    LOG("Invalid number of channels", channels, "on", devices.size(), "devices");
+    throw -23;
+  }
+}
+
+auto Config::stftParams() const -> StftParams
+{
+  return {windowSize > 0 ? windowSize : spectrSize, spectrSize, hopSize, toWindowType(window)};
+}
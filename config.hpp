@@ -0,0 +1,48 @@
+#pragma once
+#include <string>
+#include <vector>
+
+struct StftParams;
+
+// Display and analysis parameters. Loaded from the command line or a "key = value" file and
+// applied without a restart, see main.cpp.
+struct Config
+{
+  // displayed frequency range, Hz
+  float startFreq = 55;
+  float endFreq = 2 * 880;
+  // window size, pixels
+  int width = 1920;
+  int height = 1080;
+  int spectrSize = 8 * 4096;
+  int sampleFreq = 48000;
+  int hopSize = 1024;
+  // analysis window of the FFT: hann, blackman-harris or exp-decay
+  std::string window = "exp-decay";
+  // samples under the window, zero padded to the FFT size; 0 for the FFT size
+  int windowSize = 0;
+  // channels captured from every device, each one gets its own analysis lane
+  int channels = 1;
+  // capture device names, the default device if empty
+  std::vector<std::string> devices;
+  // file the note on/off events are appended to, - for stdout, none if empty
+  std::string noteEvents;
+  // shared memory segment the analyzed frames are published to, e.g. /spectrogram; none if empty
+  std::string shm;
+
+  // start-freq, end-freq, width, height, fft-size, sample-rate, hop-size, window, window-size,
+  // channels, capture-devices (comma separated), note-events and shm; # starts a comment
+  auto load(const std::string &path) -> void;
+  // returns false if key is not a config option
+  auto set(const std::string &key, const std::string &value) -> bool;
+  // --<key> <value> and --config <file>, returns the number of consumed arguments, 0 if name is not
+  // a config option
+  auto parse(const char *name, const char *value) -> int;
+  auto validate() const -> void;
+  // the STFT of the analysis: window-size samples under the window over an fft-size frame
+  auto stftParams() const -> StftParams;
+};
+
+// the configuration in effect, only changed while no analysis thread runs
+auto config() -> const Config &;
+auto setConfig(const Config &) -> void;
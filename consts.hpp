@@ -1,8 +1,10 @@
 #pragma once
 
-static const auto StartFreq = 55;
-static const auto EndFreq = 2 * 880;
-static const auto Width = 1920;
-static const auto Height = 1080;
-static const auto SpectrSize = 8 * 4096;
-static const auto SampleFreq = 48000;
+static const auto CqtBinsPerSemitone = 3;
+// 4 cents, about a pixel of the default window
+static const auto ReassignedBinsPerSemitone = 25;
+// waterfall history, frames
+static const auto LinesNum = 5 * 30;
+static const auto PianoKeys = 49 + 12;
+// peak sample value below which the input counts as silent, about -60 dBFS
+static const auto SilenceLevel = 32;
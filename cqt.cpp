@@ -0,0 +1,94 @@
+#include "cqt.hpp"
+#include "fft.hpp"
+#include <algorithm>
+#include <cmath>
+#include <complex>
+
+auto Cqt::binFreqs(CqtParams p) -> std::vector<float>
+{
+  std::vector<float> res;
+  const auto binsPerOctave = 12 * p.binsPerSemitone;
+  for (auto k = 0;; ++k)
+  {
+    const auto freq = p.minFreq * powf(2.f, 1.f * k / binsPerOctave);
+    if (freq > p.maxFreq)
+      break;
+    res.push_back(freq);
+  }
+  return res;
+}
+
+Cqt::Cqt(CqtParams p)
+{
+  const auto freqs = binFreqs(p);
+  const auto n = p.fftSize;
+  const auto q = 1. / (pow(2., 1. / (12 * p.binsPerSemitone)) - 1);
+  auto *temporal = fftwf_alloc_complex(n);
+  auto *spectral = fftwf_alloc_complex(n);
+  fftwf_plan plan;
+  {
+    std::lock_guard<std::mutex> lock(fftwPlannerMutex());
+    plan = fftwf_plan_dft_1d(n, temporal, spectral, FFTW_FORWARD, FFTW_ESTIMATE);
+  }
+
+  offsets.push_back(0);
+  for (auto freq : freqs)
+  {
+    // the lowest bins would need a window longer than the frame, they get a lower Q instead
+    const auto len = std::min(n, static_cast<int>(q * p.sampleFreq / freq));
+    std::fill(temporal[0], temporal[0] + 2 * n, 0.f);
+    auto sum = 0.;
+    for (auto i = 0; i < len; ++i)
+      sum += 0.5 - 0.5 * cos(2 * M_PI * i / len);
+    // aligned to the end of the frame where the most recent samples are; the frame comes with the
+    // rectangular STFT window which is already scaled to the exponential window level, so the
+    // n / sum factor makes the CQ level match the linear spectrum
+    for (auto i = 0; i < len; ++i)
+    {
+      const auto w = (0.5 - 0.5 * cos(2 * M_PI * i / len)) * n / sum;
+      const auto phase = 2 * M_PI * freq * i / p.sampleFreq;
+      temporal[n - len + i][0] = w * cos(phase);
+      temporal[n - len + i][1] = w * sin(phase);
+    }
+    fftwf_execute(plan);
+
+    auto max = 0.f;
+    for (auto j = 0; j <= n / 2; ++j)
+      max = std::max(max, std::abs(std::complex<float>{spectral[j][0], spectral[j][1]}));
+    for (auto j = 0; j <= n / 2; ++j)
+    {
+      // Parseval: <x, k> = <X, K> / n; drop the negligible coefficients to keep the kernel sparse
+      const auto c = std::complex<float>{spectral[j][0], spectral[j][1]};
+      if (std::abs(c) < 0.01f * max)
+        continue;
+      idx.push_back(j);
+      re.push_back(c.real() / n);
+      im.push_back(c.imag() / n);
+    }
+    offsets.push_back(idx.size());
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(fftwPlannerMutex());
+    fftwf_destroy_plan(plan);
+  }
+  fftwf_free(temporal);
+  fftwf_free(spectral);
+}
+
+auto Cqt::apply(const fftwf_complex *bins, const float *gain, float *out) const -> void
+{
+  for (auto k = 0; k < size(); ++k)
+  {
+    auto sumRe = 0.f;
+    auto sumIm = 0.f;
+    for (auto e = offsets[k]; e < offsets[k + 1]; ++e)
+    {
+      // X * conj(K)
+      const auto x = bins[idx[e]];
+      sumRe += x[0] * re[e] + x[1] * im[e];
+      sumIm += x[1] * re[e] - x[0] * im[e];
+    }
+    out[k] = gain[k] * sqrtf(sumRe * sumRe + sumIm * sumIm);
+  }
+}
@@ -0,0 +1,33 @@
+#pragma once
+#include <fftw3.h>
+#include <vector>
+
+struct CqtParams
+{
+  float minFreq;
+  float maxFreq;
+  int binsPerSemitone;
+  int fftSize;
+  int sampleFreq;
+};
+
+// FFT based constant-Q transform (Brown & Puckette). Every CQ bin is a sparse dot product of the
+// FFT frame with a precomputed spectral kernel, so the transform costs a small fraction of the
+// FFT itself and delivers a fixed number of bins per semitone.
+class Cqt
+{
+public:
+  Cqt(CqtParams);
+  static auto binFreqs(CqtParams) -> std::vector<float>;
+  auto size() const -> int { return static_cast<int>(offsets.size()) - 1; }
+  // out[k] = gain[k] * |CQ[k]|, bins are the fftSize / 2 + 1 bins of a real FFT of the frame with
+  // the rectangular window, the kernels apply their own windows
+  auto apply(const fftwf_complex *bins, const float *gain, float *out) const -> void;
+
+private:
+  // kernel of bin k occupies [offsets[k], offsets[k + 1])
+  std::vector<int> offsets;
+  std::vector<int> idx;
+  std::vector<float> re;
+  std::vector<float> im;
+};
@@ -1,24 +1,28 @@
+#include "elc.hpp"
+#include "gaussian_elimination.hpp"
+#include "simd.hpp"
 #include <algorithm>
+#include <array>
 #include <cmath>
 #include <vector>
 
-auto elcK(float freq) -> float
-{
-  // Equal Loudness Curve on 60 dB
-  // Frequency-Phon lookup table
-  const std::vector<std::pair<float, float>> elcTable = {
-    {20, 109},  {25, 104},  {31, 99},   {40, 94},    {50, 89},    {63, 85},    {80, 82},    {100, 78},
-    {125, 75},  {160, 72},  {200, 69},  {250, 67},   {315, 65},   {400, 63},   {500, 62},   {630, 60},
-    {800, 59},  {1000, 60}, {1250, 62}, {1600, 63},  {2000, 59},  {2500, 57},  {3150, 56},  {4000, 57},
-    {5000, 60}, {6300, 66}, {8000, 71}, {10000, 73}, {12500, 68}, {16000, 68}, {20000, 104}};
+// Equal Loudness Curve on 60 dB
+// Frequency-Phon lookup table
+static const std::vector<std::pair<float, float>> elcTable = {
+  {20, 109},  {25, 104},  {31, 99},   {40, 94},    {50, 89},    {63, 85},    {80, 82},    {100, 78},
+  {125, 75},  {160, 72},  {200, 69},  {250, 67},   {315, 65},   {400, 63},   {500, 62},   {630, 60},
+  {800, 59},  {1000, 60}, {1250, 62}, {1600, 63},  {2000, 59},  {2500, 57},  {3150, 56},  {4000, 57},
+  {5000, 60}, {6300, 66}, {8000, 71}, {10000, 73}, {12500, 68}, {16000, 68}, {20000, 104}};
 
+static auto interpolate(const std::vector<std::pair<float, float>> &table, float freq) -> float
+{
   auto it = std::lower_bound(
-    std::begin(elcTable), std::end(elcTable), freq, [](const auto &p, float f) { return p.first < f; });
+    std::begin(table), std::end(table), freq, [](const auto &p, float f) { return p.first < f; });
 
-  if (it == std::begin(elcTable))
-    return std::pow(10.0f, (60 - elcTable.front().second) / 20.0f);
-  else if (it == std::end(elcTable))
-    return std::pow(10.0f, (60 - elcTable.back().second) / 20.0f);
+  if (it == std::begin(table))
+    return table.front().second;
+  else if (it == std::end(table))
+    return table.back().second;
   else
   {
     const auto &prevEntry = *(it - 1);
@@ -31,8 +35,169 @@ auto elcK(float freq) -> float
     const auto nextPhon = nextEntry.second;
 
     const auto alpha = (freq - prevFreq) / (nextFreq - prevFreq);
-    const auto interpolatedPhon = (1.0f - alpha) * prevPhon + alpha * nextPhon;
+    return (1.0f - alpha) * prevPhon + alpha * nextPhon;
+  }
+}
 
-    return std::pow(10.0f, (60 - interpolatedPhon) / 20.0f);
+auto elcK(float freq) -> float
+{
+  return std::pow(10.0f, (60 - interpolate(elcTable, freq)) / 20.0f);
+}
+
+// the phon table against the log frequency mapped to -1..1, well conditioned for the fit
+static auto toFitX(float freq) -> float
+{
+  const auto lo = log10f(elcTable.front().first);
+  const auto hi = log10f(elcTable.back().first);
+  return (log10f(std::clamp(freq, elcTable.front().first, elcTable.back().first)) - lo) / (hi - lo) * 2 - 1;
+}
+
+// Chebyshev polynomials T0(x)..Tn(x), their normal equations stay well conditioned in floats
+static auto chebyshev(float x, float *t, int n) -> void
+{
+  t[0] = 1;
+  t[1] = x;
+  for (auto i = 2; i < n; ++i)
+    t[i] = 2 * x * t[i - 1] - t[i - 2];
+}
+
+static const auto ElcFitTerms = 11;
+
+// least squares fit of the phon table, done once
+static auto elcFit() -> const std::vector<float> &
+{
+  static const auto coefs = []() {
+    Matrix a(elcTable.size(), ElcFitTerms);
+    std::vector<float> b;
+    for (auto r = 0; r < a.rows(); ++r)
+    {
+      chebyshev(toFitX(elcTable[r].first), a.row(r), ElcFitTerms);
+      b.push_back(elcTable[r].second);
+    }
+    Matrix normal;
+    std::vector<float> res(ElcFitTerms);
+    GaussianElimination::leastSquares(a, b.data(), normal, res.data());
+    return res;
+  }();
+  return coefs;
+}
+
+auto elcFitK(float freq) -> float
+{
+  const auto &coefs = elcFit();
+  float t[ElcFitTerms];
+  chebyshev(toFitX(freq), t, ElcFitTerms);
+  auto phon = 0.f;
+  for (auto i = 0; i < ElcFitTerms; ++i)
+    phon += coefs[i] * t[i];
+  return std::pow(10.0f, (60 - phon) / 20.0f);
+}
+
+// ISO 226:2003 equal loudness contour, sound pressure level for the given loudness level
+static auto iso226(float phon) -> std::vector<std::pair<float, float>>
+{
+  constexpr std::array<float, 29> f = {20,   25,   31.5, 40,   50,   63,   80,    100,   125,  160,
+                                       200,  250,  315,  400,  500,  630,  800,   1000,  1250, 1600,
+                                       2000, 2500, 3150, 4000, 5000, 6300, 8000,  10000, 12500};
+  constexpr std::array<float, 29> af = {0.532, 0.506, 0.480, 0.455, 0.432, 0.409, 0.387, 0.367,
+                                        0.349, 0.330, 0.315, 0.301, 0.288, 0.276, 0.267, 0.259,
+                                        0.253, 0.250, 0.246, 0.244, 0.243, 0.243, 0.243, 0.242,
+                                        0.242, 0.245, 0.254, 0.271, 0.301};
+  constexpr std::array<float, 29> lu = {-31.6, -27.2, -23.0, -19.1, -15.9, -13.0, -10.3, -8.1,
+                                        -6.2,  -4.5,  -3.1,  -2.0,  -1.1,  -0.4,  0.0,   0.3,
+                                        0.5,   0.0,   -2.7,  -4.1,  -1.0,  1.7,   2.5,   1.2,
+                                        -2.1,  -7.1,  -11.2, -10.7, -3.1};
+  constexpr std::array<float, 29> tf = {78.5, 68.7, 59.5, 51.1, 44.0, 37.5, 31.5, 26.5, 22.1, 17.9,
+                                        14.4, 11.4, 8.6,  6.2,  4.4,  3.0,  2.2,  2.4,  3.5,  1.7,
+                                        -1.3, -4.2, -6.0, -5.4, -1.5, 6.0,  12.6, 13.9, 12.3};
+  std::vector<std::pair<float, float>> res;
+  for (auto i = 0U; i < f.size(); ++i)
+  {
+    const auto a = 4.47e-3 * (std::pow(10.0, 0.025 * phon) - 1.15) +
+                   std::pow(0.4 * std::pow(10.0, (tf[i] + lu[i]) / 10.0 - 9.0), af[i]);
+    res.emplace_back(f[i], static_cast<float>(10.0 / af[i] * std::log10(a) - lu[i] + 94.0));
   }
+  return res;
+}
+
+static auto aWeighting(float freq) -> float
+{
+  const auto f2 = 1.0 * freq * freq;
+  const auto r = 12194.0 * 12194.0 * f2 * f2 /
+                 ((f2 + 20.6 * 20.6) * std::sqrt((f2 + 107.7 * 107.7) * (f2 + 737.9 * 737.9)) *
+                  (f2 + 12194.0 * 12194.0));
+  return static_cast<float>(r * std::pow(10.0, 2.0 / 20.0));
+}
+
+static auto cWeighting(float freq) -> float
+{
+  const auto f2 = 1.0 * freq * freq;
+  const auto r = 12194.0 * 12194.0 * f2 / ((f2 + 20.6 * 20.6) * (f2 + 12194.0 * 12194.0));
+  return static_cast<float>(r * std::pow(10.0, 0.06 / 20.0));
+}
+
+auto toString(Weighting w) -> const char *
+{
+  switch (w)
+  {
+  case Weighting::Elc60: return "ELC 60 phon";
+  case Weighting::Elc60Fit: return "ELC 60 phon fitted";
+  case Weighting::Iso226_40: return "ISO 226 40 phon";
+  case Weighting::Iso226_60: return "ISO 226 60 phon";
+  case Weighting::Iso226_80: return "ISO 226 80 phon";
+  case Weighting::A: return "A-weighting";
+  case Weighting::C: return "C-weighting";
+  case Weighting::Flat: return "flat";
+  case Weighting::Count: break;
+  }
+  return "unknown";
+}
+
+static auto linearFreqs(int fftSize, int sampleFreq) -> std::vector<float>
+{
+  std::vector<float> res(fftSize / 2 + 1);
+  for (auto i = 0U; i < res.size(); ++i)
+    res[i] = 1.f * i * sampleFreq / fftSize;
+  return res;
+}
+
+ElcTable::ElcTable(Weighting w, int fftSize, int sampleFreq)
+  : ElcTable(w, linearFreqs(fftSize, sampleFreq))
+{
+}
+
+ElcTable::ElcTable(Weighting w, const std::vector<float> &freqs) : w(w), gains(freqs.size())
+{
+  const auto isoPhon = [w]() {
+    switch (w)
+    {
+    case Weighting::Iso226_40: return 40.f;
+    case Weighting::Iso226_80: return 80.f;
+    default: return 60.f;
+    }
+  }();
+  const auto iso = iso226(isoPhon);
+  for (auto i = 0U; i < gains.size(); ++i)
+  {
+    const auto freq = freqs[i];
+    switch (w)
+    {
+    case Weighting::Elc60: gains[i] = elcK(freq); break;
+    case Weighting::Elc60Fit: gains[i] = elcFitK(freq); break;
+    case Weighting::Iso226_40:
+    case Weighting::Iso226_60:
+    case Weighting::Iso226_80:
+      gains[i] = std::pow(10.0f, (isoPhon - interpolate(iso, freq)) / 20.0f);
+      break;
+    case Weighting::A: gains[i] = aWeighting(freq); break;
+    case Weighting::C: gains[i] = cWeighting(freq); break;
+    case Weighting::Flat:
+    case Weighting::Count: gains[i] = 1.f; break;
+    }
+  }
+}
+
+auto ElcTable::apply(const fftwf_complex *bins, float *out, int size) const -> void
+{
+  Simd::magnitude(bins, gains.data(), out, size);
 }
@@ -1,3 +1,39 @@
 #pragma once
+#include <fftw3.h>
+#include <vector>
 
 auto elcK(float freq) -> float;
+// the same curve smoothed by a least squares polynomial over the log frequency
+auto elcFitK(float freq) -> float;
+
+enum class Weighting {
+  Elc60,    // the original 60 phon equal loudness curve
+  Elc60Fit, // the same without the corners of the linear interpolation
+  Iso226_40,
+  Iso226_60,
+  Iso226_80,
+  A,
+  C,
+  Flat,
+  Count
+};
+
+auto toString(Weighting) -> const char *;
+
+// Per-bin equal loudness gains precomputed for a given FFT size and sample rate, or for arbitrary
+// bin frequencies
+class ElcTable
+{
+public:
+  ElcTable(Weighting, int fftSize, int sampleFreq);
+  ElcTable(Weighting, const std::vector<float> &freqs);
+  auto weighting() const -> Weighting { return w; }
+  auto operator[](int bin) const -> float { return gains[bin]; }
+  auto data() const -> const float * { return gains.data(); }
+  // out[i] = gain[i] * |bins[i]|, for i in [0, size)
+  auto apply(const fftwf_complex *bins, float *out, int size) const -> void;
+
+private:
+  Weighting w;
+  std::vector<float> gains;
+};
@@ -0,0 +1,107 @@
+#include "fft.hpp"
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <log/log.hpp>
+#include <map>
+#include <string>
+
+auto fftwPlannerMutex() -> std::mutex &
+{
+  static std::mutex mutex;
+  return mutex;
+}
+
+static auto wisdomPath() -> std::string
+{
+  if (const auto cache = getenv("XDG_CACHE_HOME"))
+    return std::string{cache} + "/spectrogram.wisdom";
+  if (const auto home = getenv("HOME"))
+    return std::string{home} + "/.cache/spectrogram.wisdom";
+  return "spectrogram.wisdom";
+}
+
+// plans from the cached wisdom if possible, otherwise measures and saves the new wisdom; called
+// with the planner mutex held
+template <typename F>
+static auto makePlan(const char *name, int n, F &&plan) -> fftwf_plan
+{
+  static auto isWisdomLoaded = false;
+  if (!isWisdomLoaded)
+  {
+    isWisdomLoaded = true;
+    if (!fftwf_import_wisdom_from_filename(wisdomPath().c_str()))
+      LOG("No FFTW wisdom in", wisdomPath());
+  }
+
+  const auto t1 = std::chrono::steady_clock::now();
+  auto res = plan(FFTW_MEASURE | FFTW_WISDOM_ONLY);
+  if (!res)
+  {
+    res = plan(FFTW_MEASURE);
+    if (!fftwf_export_wisdom_to_filename(wisdomPath().c_str()))
+      LOG("Could not save FFTW wisdom to", wisdomPath());
+  }
+  const auto t2 = std::chrono::steady_clock::now();
+  LOG(name, n, "planned in", std::chrono::duration<float, std::milli>(t2 - t1).count(), "ms");
+  return res;
+}
+
+Fft::Fft(int size)
+  : n(size), input(fftwf_alloc_real(size)), output(fftwf_alloc_complex(size / 2 + 1))
+{
+  {
+    // the new-array execute needs the same alignment as the planning arrays, fftwf_alloc_* always
+    // gives the SIMD one
+    std::lock_guard<std::mutex> lock(fftwPlannerMutex());
+    static std::map<int, fftwf_plan> plans;
+    auto &p = plans[n];
+    if (!p)
+      p = makePlan("FFT", n, [this](unsigned flags) { return fftwf_plan_dft_r2c_1d(n, input, output, flags); });
+    plan = p;
+  }
+  // FFTW_MEASURE overwrites the arrays while planning
+  memset(input, 0, n * sizeof(float));
+  memset(output, 0, (n / 2 + 1) * sizeof(fftwf_complex));
+}
+
+Fft::~Fft()
+{
+  fftwf_free(input);
+  fftwf_free(output);
+}
+
+auto Fft::execute() -> void
+{
+  fftwf_execute_dft_r2c(plan, input, output);
+}
+
+Dct::Dct(int size) : n(size), buf(fftwf_alloc_real(size))
+{
+  std::lock_guard<std::mutex> lock(fftwPlannerMutex());
+  forwardPlan =
+    makePlan("DCT", n, [this](unsigned flags) { return fftwf_plan_r2r_1d(n, buf, buf, FFTW_REDFT10, flags); });
+  inversePlan =
+    makePlan("IDCT", n, [this](unsigned flags) { return fftwf_plan_r2r_1d(n, buf, buf, FFTW_REDFT01, flags); });
+  memset(buf, 0, n * sizeof(float));
+}
+
+Dct::~Dct()
+{
+  {
+    std::lock_guard<std::mutex> lock(fftwPlannerMutex());
+    fftwf_destroy_plan(forwardPlan);
+    fftwf_destroy_plan(inversePlan);
+  }
+  fftwf_free(buf);
+}
+
+auto Dct::forward() -> void
+{
+  fftwf_execute(forwardPlan);
+}
+
+auto Dct::inverse() -> void
+{
+  fftwf_execute(inversePlan);
+}
@@ -0,0 +1,53 @@
+#pragma once
+#include <fftw3.h>
+#include <mutex>
+
+// FFTW planner is not thread safe, hold it while creating or destroying any plan
+auto fftwPlannerMutex() -> std::mutex &;
+
+// Real-to-complex single precision FFT. Plans are created with FFTW_MEASURE and the resulting
+// wisdom is cached on disk, so only the very first launch pays for the planning. All the objects
+// of one size share a read-only plan and only own their buffers, so any number of them can run on
+// different threads without the planner.
+class Fft
+{
+public:
+  Fft(int size);
+  ~Fft();
+  Fft(const Fft &) = delete;
+  Fft &operator=(const Fft &) = delete;
+  auto size() const -> int { return n; }
+  // size() real samples
+  auto in() -> float * { return input; }
+  // size() / 2 + 1 complex bins
+  auto out() -> fftwf_complex * { return output; }
+  auto execute() -> void;
+
+private:
+  int n;
+  float *input;
+  fftwf_complex *output;
+  // owned by the plan cache, lives until the exit
+  fftwf_plan plan;
+};
+
+// DCT-II and its inverse (DCT-III) of the same buffer, in place. Unnormalized like FFTW:
+// inverse(forward(x)) = 2 * size() * x. Planned the same way as Fft.
+class Dct
+{
+public:
+  Dct(int size);
+  ~Dct();
+  Dct(const Dct &) = delete;
+  Dct &operator=(const Dct &) = delete;
+  auto size() const -> int { return n; }
+  auto data() -> float * { return buf; }
+  auto forward() -> void;
+  auto inverse() -> void;
+
+private:
+  int n;
+  float *buf;
+  fftwf_plan forwardPlan;
+  fftwf_plan inversePlan;
+};
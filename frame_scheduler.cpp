@@ -0,0 +1,70 @@
+#include "frame_scheduler.hpp"
+#include "config.hpp"
+#include <thread>
+
+// how long the input has to be silent before the loop slows down
+static const auto IdleDelay = std::chrono::seconds(2);
+
+auto toString(Pacing value) -> const char *
+{
+  switch (value)
+  {
+  case Pacing::Vsync: return "vsync";
+  case Pacing::Fixed: return "fixed";
+  case Pacing::OnDemand: return "on demand";
+  case Pacing::Count: break;
+  }
+  return "unknown";
+}
+
+FrameScheduler::FrameScheduler(Pacing mode, float fps, float idleFps)
+  : mode(mode),
+    period(std::chrono::duration_cast<Clock::duration>(std::chrono::duration<float>(1.f / fps))),
+    idlePeriod(
+      std::chrono::duration_cast<Clock::duration>(std::chrono::duration<float>(1.f / idleFps))),
+    // a quarter of a hop, a new spectrum is picked up at most this late
+    pollPeriod(std::chrono::microseconds(250'000LL * config().hopSize / config().sampleFreq)),
+    next(Clock::now()),
+    lastSound(Clock::now())
+{
+}
+
+auto FrameScheduler::setPacing(Pacing value) -> void
+{
+  mode = value;
+  next = Clock::now();
+}
+
+auto FrameScheduler::pacing() const -> Pacing
+{
+  return mode;
+}
+
+auto FrameScheduler::vsync() const -> bool
+{
+  return mode == Pacing::Vsync;
+}
+
+auto FrameScheduler::wait(bool isSilent) -> void
+{
+  const auto now = Clock::now();
+  if (!isSilent)
+    lastSound = now;
+  idle = now - lastSound > IdleDelay;
+  if (idle)
+    next += idlePeriod;
+  else if (mode == Pacing::Fixed)
+    next += period;
+  else
+    // vsync blocks in the swap, so both polling modes only have to look for new spectra
+    next += pollPeriod;
+  // do not try to catch up after a slow frame
+  if (next < now)
+    next = now;
+  std::this_thread::sleep_until(next);
+}
+
+auto FrameScheduler::isIdle() const -> bool
+{
+  return idle;
+}
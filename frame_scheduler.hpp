@@ -0,0 +1,36 @@
+#pragma once
+#include <chrono>
+
+enum class Pacing { Vsync, Fixed, OnDemand, Count };
+
+auto toString(Pacing) -> const char *;
+
+// Decides when the main loop draws and sleeps between the frames with the steady clock.
+//  - Vsync: the swap is locked to the display refresh, a frame is drawn at the first vblank after
+//    a new spectrum arrived.
+//  - Fixed: a frame is drawn at most every 1/fps seconds.
+//  - OnDemand: a frame is drawn as soon as a new spectrum arrived.
+// In every mode the loop drops to idleFps once the input has been silent for a while.
+class FrameScheduler
+{
+public:
+  FrameScheduler(Pacing, float fps, float idleFps);
+  auto setPacing(Pacing) -> void;
+  auto pacing() const -> Pacing;
+  // true if the swap should wait for the vertical blank
+  auto vsync() const -> bool;
+  // sleeps until the next iteration of the main loop is due
+  auto wait(bool isSilent) -> void;
+  auto isIdle() const -> bool;
+
+private:
+  using Clock = std::chrono::steady_clock;
+  Pacing mode;
+  Clock::duration period;
+  Clock::duration idlePeriod;
+  // how often the polling modes check for a new spectrum
+  Clock::duration pollPeriod;
+  Clock::time_point next;
+  Clock::time_point lastSound;
+  bool idle = false;
+};
@@ -1,65 +1,87 @@
 #include "gaussian_elimination.hpp"
+#include "simd.hpp"
+#include <algorithm>
 #include <cmath>
 
-static void elimination(Matrix &eqns)
+Matrix::Matrix(int rows, int cols) : rowsNum(rows), colsNum(cols), values(rows * cols) {}
+
+auto Matrix::resize(int rows, int cols) -> void
 {
-  // 'eqns' is the matrix, 'rows' is no. of vars
-  int rows = eqns.size(), cols = eqns[0].size();
+  rowsNum = rows;
+  colsNum = cols;
+  values.assign(rows * cols, 0.f);
+}
 
-  for (int i = 0; i < rows - 1; i++)
+namespace GaussianElimination
+{
+  auto solve(Matrix &m) -> bool
   {
-    int pivot = i;
-
-    for (int j = i + 1; j < rows; j++)
+    const auto rows = m.rows();
+    const auto cols = m.cols();
+    for (auto i = 0; i < rows; ++i)
     {
-      if (std::abs(eqns[j][i]) > std::abs(eqns[pivot][i]))
-        pivot = j;
+      auto pivot = i;
+      for (auto j = i + 1; j < rows; ++j)
+        if (std::abs(m(j, i)) > std::abs(m(pivot, i)))
+          pivot = j;
+      if (m(pivot, i) == 0)
+        return false;
+      if (pivot != i)
+        std::swap_ranges(m.row(i) + i, m.row(i) + cols, m.row(pivot) + i);
+      // the columns left of i are already 0
+      for (auto j = i + 1; j < rows; ++j)
+        Simd::addScaled(m.row(i) + i, -m(j, i) / m(i, i), m.row(j) + i, cols - i);
     }
-
-    if (eqns[pivot][i] == 0.0)
-      continue; // But continuing to simplify the matrix as much as possible
-
-    if (i != pivot)                    // Swapping the rows if new row with higher maxVals is found
-      std::swap(eqns[pivot], eqns[i]); // C++ swap function
-
-    for (int j = i + 1; j < rows; j++)
+    // back substitution on the right hand sides only
+    for (auto i = rows - 1; i >= 0; --i)
     {
-      float scale = eqns[j][i] / eqns[i][i];
-
-      for (int k = i + 1; k < cols; k++)  // k doesn't start at 0, since
-        eqns[j][k] -= scale * eqns[i][k]; // values before from 0 to i
-                                          // are already 0
-      eqns[j][i] = 0.0;
+      Simd::scale(m.row(i) + rows, 1.f / m(i, i), m.row(i) + rows, cols - rows);
+      for (auto j = 0; j < i; ++j)
+        Simd::addScaled(m.row(i) + rows, -m(j, i), m.row(j) + rows, cols - rows);
     }
+    return true;
   }
-}
-
-static std::vector<float> backSubs(const Matrix &eqns)
-{
-  // 'eqns' is matrix, 'rows' is no. of variables
-  int rows = eqns.size();
 
-  std::vector<float> ans(rows);
-  for (int i = rows - 1; i >= 0; i--)
+  auto leastSquares(const Matrix &a, const float *b, Matrix &normal, float *x) -> bool
   {
-    float sum = 0.0;
-
-    for (int j = i + 1; j < rows; j++)
-      sum += eqns[i][j] * ans[j];
+    const auto n = a.cols();
+    normal.resize(n, n + 1);
+    // one row of a at a time, the rows of the normal matrix are its multiples
+    for (auto r = 0; r < a.rows(); ++r)
+    {
+      const auto *row = a.row(r);
+      for (auto i = 0; i < n; ++i)
+      {
+        Simd::addScaled(row, row[i], normal.row(i), n);
+        normal(i, n) += row[i] * b[r];
+      }
+    }
+    if (!solve(normal))
+      return false;
+    for (auto i = 0; i < n; ++i)
+      x[i] = normal(i, n);
+    return true;
+  }
 
-    if (eqns[i][i] != 0)
-      ans[i] = (eqns[i][rows] - sum) / eqns[i][i];
-    else
-      return std::vector<float>(0);
+  Batch::Batch(int size, int count)
+    : n(size), num(count), values(size * (size + 1) * count), factors(count)
+  {
   }
-  return ans;
-}
 
-namespace GaussianElimination
-{
-  std::vector<float> solve(Matrix val)
+  auto Batch::solve() -> void
   {
-    elimination(val);
-    return backSubs(val);
+    for (auto i = 0; i < n; ++i)
+      for (auto j = i + 1; j < n; ++j)
+      {
+        Simd::divide(at(j, i), at(i, i), 1.f, factors.data(), num);
+        for (auto k = i + 1; k <= n; ++k)
+          Simd::subtractProduct(factors.data(), at(i, k), at(j, k), num);
+      }
+    for (auto i = n - 1; i >= 0; --i)
+    {
+      for (auto k = i + 1; k < n; ++k)
+        Simd::subtractProduct(at(i, k), at(k, n), at(i, n), num);
+      Simd::divide(at(i, n), at(i, i), 1.f, at(i, n), num);
+    }
   }
 } // namespace GaussianElimination
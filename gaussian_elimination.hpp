@@ -2,9 +2,55 @@
 
 #include <vector>
 
-using Matrix = std::vector<std::vector<float>>;
+// Dense row-major matrix, the rows are contiguous
+class Matrix
+{
+public:
+  Matrix(int rows = 0, int cols = 0);
+  auto rows() const -> int { return rowsNum; }
+  auto cols() const -> int { return colsNum; }
+  auto operator()(int r, int c) -> float & { return values[r * colsNum + c]; }
+  auto operator()(int r, int c) const -> float { return values[r * colsNum + c]; }
+  auto row(int r) -> float * { return values.data() + r * colsNum; }
+  auto row(int r) const -> const float * { return values.data() + r * colsNum; }
+  // zeroes the elements, keeps the storage if it is large enough
+  auto resize(int rows, int cols) -> void;
+
+private:
+  int rowsNum;
+  int colsNum;
+  std::vector<float> values;
+};
 
+// Direct solvers for the small dense systems of the curve fits. The row operations run on the
+// Simd kernels and nothing allocates once the storage is sized.
 namespace GaussianElimination
 {
-  std::vector<float> solve(Matrix);
-}
+  // solves the n x (n + k) augmented system in place with partial pivoting, the solutions replace the
+  // k right hand sides; returns false if the system is singular
+  auto solve(Matrix &augmented) -> bool;
+  // least squares solution x of a x = b through the normal equations; normal is the scratch, x has
+  // a.cols() values
+  auto leastSquares(const Matrix &a, const float *b, Matrix &normal, float *x) -> bool;
+
+  // Many systems of the same size solved at once. The systems are interleaved element by element,
+  // so every row operation runs over all of them. There is no pivoting: meant for symmetric
+  // positive definite systems such as normal equations, a zero pivot spoils its system only.
+  class Batch
+  {
+  public:
+    Batch(int size = 0, int count = 0);
+    auto size() const -> int { return n; }
+    auto count() const -> int { return num; }
+    // the element (r, c) of all the systems, c == size() is the right hand side
+    auto at(int r, int c) -> float * { return values.data() + (r * (n + 1) + c) * num; }
+    // the solutions replace the right hand sides
+    auto solve() -> void;
+
+  private:
+    int n;
+    int num;
+    std::vector<float> values;
+    std::vector<float> factors;
+  };
+} // namespace GaussianElimination
@@ -0,0 +1,177 @@
+#include "headless.hpp"
+#include "alloc_counter.hpp"
+#include "config.hpp"
+#include "consts.hpp"
+#include "elc.hpp"
+#include "pcm_reader.hpp"
+#include "pitch_tracker.hpp"
+#include "png_writer.hpp"
+#include "reassignment.hpp"
+#include "soft_rend.hpp"
+#include "spectral_norm.hpp"
+#include "stft.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <log/log.hpp>
+#include <memory>
+#include <string>
+
+auto headlessUsage() -> const char *
+{
+  return "<input.wav|input.raw> <frame-%06d.png|output.rgba|-> [--smart-scale] [--reassign] "
+         "[--envelope <off|iir|cepstral|min-track|poly>] [--rate <raw sample rate>] [--fps <frames per second>] "
+         "[--config <file>] [--<config option> <value>]";
+}
+
+auto headless(int argc, const char *argv[]) -> int
+{
+  if (argc < 4)
+  {
+    fprintf(stderr, "Usage: %s --render %s\n", argv[0], headlessUsage());
+    return 1;
+  }
+  const std::string input = argv[2];
+  const std::string output = argv[3];
+  auto envelope = Envelope::None;
+  auto cfg = config();
+  auto rawRate = cfg.sampleFreq;
+  auto fps = 30;
+  auto reassign = false;
+  for (auto i = 4; i < argc; ++i)
+    if (strcmp(argv[i], "--smart-scale") == 0)
+      envelope = Envelope::Iir;
+    else if (strcmp(argv[i], "--reassign") == 0)
+      reassign = true;
+    else if (strcmp(argv[i], "--envelope") == 0 && i + 1 < argc)
+      envelope = toEnvelope(argv[++i]);
+    else if (strcmp(argv[i], "--rate") == 0 && i + 1 < argc)
+      rawRate = std::stoi(argv[++i]);
+    else if (strcmp(argv[i], "--fps") == 0 && i + 1 < argc)
+      fps = std::stoi(argv[++i]);
+    else if (const auto n = cfg.parse(argv[i], i + 1 < argc ? argv[i + 1] : nullptr))
+      i += n - 1;
+  setConfig(cfg);
+  const auto spectrSize = cfg.spectrSize;
+  auto stftParams = cfg.stftParams();
+  const auto hopSize = cfg.hopSize;
+  const auto width = cfg.width;
+  const auto height = cfg.height;
+
+  PcmReader reader(input, rawRate);
+  const auto rate = reader.sampleFreq();
+  // the reassigned partials of the live mode come from the bins of the rectangular window
+  if (reassign)
+    stftParams.window = WindowType::Rectangular;
+  Stft stft(stftParams);
+  std::unique_ptr<Reassignment> reassignment;
+  std::vector<float> freqs;
+  if (reassign)
+  {
+    const auto params = ReassignmentParams{
+      cfg.startFreq * powf(2.f, -1.f / 12.f), rate / 2.f, ReassignedBinsPerSemitone, spectrSize, rate};
+    reassignment = std::make_unique<Reassignment>(params);
+    freqs = Reassignment::binFreqs(params);
+  }
+  else
+    for (auto i = 0; i < spectrSize / 2; ++i)
+      freqs.push_back(1.f * i * rate / spectrSize);
+  const auto elc = reassign ? ElcTable(Weighting::Elc60, freqs) : ElcTable(Weighting::Elc60, spectrSize, rate);
+  PitchTracker tracker(freqs, fps);
+  SpectralNorm norm(freqs, fps);
+  SoftRend rend;
+  rend.setFreqs(freqs);
+
+  // a printf pattern gives one PNG per frame, anything else is a raw RGBA stream for a video encoder
+  const auto isPng = output.find('%') != std::string::npos;
+  FILE *raw = nullptr;
+  if (!isPng)
+  {
+    raw = output == "-" ? stdout : fopen(output.c_str(), "wb");
+    if (!raw)
+    {
+      LOG("Could not create", output);
+      throw -16;
+    }
+  }
+  FILE *notes = nullptr;
+  if (!cfg.noteEvents.empty())
+  {
+    notes = cfg.noteEvents == "-" ? stdout : fopen(cfg.noteEvents.c_str(), "w");
+    if (!notes)
+    {
+      LOG("Could not create", cfg.noteEvents);
+      throw -16;
+    }
+  }
+
+  std::vector<int16_t> samples(stftParams.windowSize);
+  std::vector<float> spectr(freqs.size());
+  const auto frames = static_cast<int64_t>(reader.size()) * fps / rate;
+  const auto t1 = std::chrono::steady_clock::now();
+  for (auto frame = int64_t{0}; frame < frames; ++frame)
+  {
+    // the live view shows the last complete hop at the time of the frame
+    const auto last = (frame + 1) * rate / fps / hopSize * hopSize;
+    const auto first = last - stftParams.windowSize;
+    const auto silence = static_cast<std::size_t>(std::max<int64_t>(0, -first));
+    std::fill(samples.data(), samples.data() + silence, 0);
+    reader.read(std::max<int64_t>(0, first), samples.data() + silence, stftParams.windowSize - silence);
+    const auto *bins = stft.frame(samples.data());
+    if (reassignment)
+      reassignment->apply(bins, elc.data(), spectr.data());
+    else
+      elc.apply(bins, spectr.data(), spectr.size());
+    tracker.apply(spectr.data(), elc.data());
+    if (notes)
+      for (const auto key : tracker.changes())
+      {
+        const auto c = tracker.notes()[key];
+        write(notes,
+              NoteEvent{1.f * last / rate,
+                        0,
+                        static_cast<uint8_t>(key),
+                        static_cast<uint8_t>(lroundf(c * 255)),
+                        c > 0});
+      }
+    norm.apply(spectr.data(), spectr.data(), envelope);
+    {
+      // only the first frame sizes the scratch buffers
+      AllocScope allocs(frame > 0);
+      rend.rend(spectr, tracker.notes(), envelope != Envelope::None);
+    }
+
+    const auto &pixels = rend.pixels();
+    if (isPng)
+    {
+      char path[4096];
+      snprintf(path, sizeof(path), output.c_str(), static_cast<int>(frame));
+      PngWriter png(path, width, height, 4);
+      for (auto row = 0; row < height; ++row)
+        png.addRow(pixels.data() + row * width * 4);
+    }
+    else
+      fwrite(pixels.data(), 1, pixels.size(), raw);
+    reader.release(std::max<int64_t>(0, first));
+  }
+  if (raw && raw != stdout)
+    fclose(raw);
+  if (notes && notes != stdout)
+    fclose(notes);
+  const auto t2 = std::chrono::steady_clock::now();
+
+  const auto secs = std::chrono::duration<double>(t2 - t1).count();
+  LOG("Frames:",
+      frames,
+      "time:",
+      secs,
+      "s",
+      "throughput:",
+      frames / secs,
+      "frames/s",
+      1.0 * frames / fps / secs,
+      "x real time");
+  return 0;
+}
@@ -0,0 +1,8 @@
+#pragma once
+
+// Renders the live view of an audio file without a display:
+// spectrogram --render <input.wav|input.raw> <frame-%06d.png|output.rgba|-> [--smart-scale]
+// [--reassign] [--envelope <off|iir|cepstral|min-track|poly>] [--rate <raw sample rate>] [--fps <frames per second>] [--config <file>] [--<config option> <value>]
+auto headless(int argc, const char *argv[]) -> int;
+// the arguments after --render
+auto headlessUsage() -> const char *;
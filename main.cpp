@@ -1,11 +1,26 @@
+#include "accuracy.hpp"
+#include "alloc_counter.hpp"
+#include "analyzer.hpp"
+#include "bench.hpp"
+#include "config.hpp"
 #include "consts.hpp"
-#include "elc.hpp"
+#include "frame_scheduler.hpp"
+#include "headless.hpp"
+#include "offline.hpp"
+#include "profiler.hpp"
+#include "recording_tool.hpp"
 #include "rend.hpp"
+#include "shm_tool.hpp"
 #include <algorithm>
-#include <fftw3.h>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <iterator>
 #include <log/log.hpp>
 #include <memory>
-#include <mutex>
+#include <stdexcept>
+#include <string>
 #include <vector>
 
 #include <sdlpp/sdlpp.hpp>
@@ -16,14 +31,55 @@
 
 #include <GL/glu.h>
 
-fftw_plan plan;
-fftw_complex *input;
-fftw_complex *output;
-std::vector<float> spectr;
-std::mutex mutex;
+namespace
+{
+  // a mode without a window, selected by the first argument
+  struct Mode
+  {
+    const char *flag;
+    int (*run)(int argc, const char *argv[]);
+    const char *(*usage)();
+  };
+
+  const Mode Modes[] = {{"--bench", bench, benchUsage},
+                        {"--accuracy", accuracy, accuracyUsage},
+                        {"--offline", offline, offlineUsage},
+                        {"--render", headless, headlessUsage},
+                        {"--read-shm", readShm, readShmUsage},
+                        {"--shm-test", shmTest, shmTestUsage},
+                        {"--recording-test", recordingTest, recordingTestUsage}};
+
+  // a bad argument or config ends the mode with its usage and a non-zero exit code
+  auto runMode(const Mode &mode, int argc, const char *argv[]) -> int
+  {
+    try
+    {
+      return mode.run(argc, argv);
+    }
+    catch (int e)
+    {
+      LOG(mode.flag, "failed with error", e);
+    }
+    catch (const std::exception &e)
+    {
+      LOG(mode.flag, "failed:", e.what());
+    }
+    fprintf(stderr, "Usage: %s %s %s\n", argv[0], mode.flag, mode.usage());
+    return 1;
+  }
+} // namespace
 
 int main(int argc, const char *argv[])
 {
+  const auto startTime = std::chrono::steady_clock::now();
+  if (argc == 2 && argv[1] == std::string{"--bench-kernels"})
+    return benchKernels();
+  for (const auto &mode : Modes)
+    if (argc >= 2 && argv[1] == std::string{mode.flag})
+      return runMode(mode, argc, argv);
+  // the timers run only for the HUD or a dump at exit
+  const auto profilePath = getenv("SPECTROGRAM_PROFILE");
+  Profiler::instance().setEnabled(profilePath != nullptr);
   sdl::Init init(SDL_INIT_EVERYTHING);
   SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, 3);
   SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 1);
@@ -31,13 +87,46 @@ int main(int argc, const char *argv[])
   SDL_SetHint(SDL_HINT_VIDEO_X11_NET_WM_BYPASS_COMPOSITOR, "0");
   auto x = 1921;
   auto y = 2161;
-  if (argc == 3)
+  // the window position and the config options, F6 parses them again to apply the changes of the
+  // config file
+  const auto loadConfig = [argc, argv, &x, &y]() {
+    auto cfg = Config{};
+    std::vector<int> position;
+    for (auto i = 1; i < argc; ++i)
+      if (const auto n = cfg.parse(argv[i], i + 1 < argc ? argv[i + 1] : nullptr))
+        i += n - 1;
+      else
+        try
+        {
+          position.push_back(std::stoi(argv[i]));
+        }
+        catch (const std::logic_error &)
+        {
+          LOG("Unknown option", argv[i]);
+          throw -22;
+        }
+    if (position.size() == 2)
+    {
+      x = position[0];
+      y = position[1];
+    }
+    return cfg;
+  };
+  try
   {
-    x = std::stoi(argv[1]);
-    y = std::stoi(argv[2]);
+    setConfig(loadConfig());
   }
-  sdl::Window w(
-    "Spectrogram", x, y, Width, Height, SDL_WINDOW_OPENGL | SDL_WINDOW_SHOWN | SDL_WINDOW_BORDERLESS);
+  catch (int)
+  {
+    LOG("Config is not applied");
+    return 1;
+  }
+  sdl::Window w("Spectrogram",
+                x,
+                y,
+                config().width,
+                config().height,
+                SDL_WINDOW_OPENGL | SDL_WINDOW_SHOWN | SDL_WINDOW_BORDERLESS);
   Rend rend(w);
   {
     auto icon = sdl::Surface(SDL_LoadBMP("icon.bmp"));
@@ -48,55 +137,85 @@ int main(int argc, const char *argv[])
   auto done = false;
   e.quit = [&done](const SDL_QuitEvent &) { done = true; };
 
-  auto want = []() {
+  const auto makeWant = []() {
     SDL_AudioSpec want;
-    want.freq = SampleFreq;
+    want.freq = config().sampleFreq;
     want.format = AUDIO_S16;
-    want.channels = 1;
-    want.samples = 1024;
+    want.channels = config().channels;
+    want.samples = config().hopSize;
     return want;
-  }();
-  input = fftw_alloc_complex(SpectrSize);
-  output = fftw_alloc_complex(SpectrSize);
-  memset(input, 0, SpectrSize * sizeof(fftw_complex));
-  memset(output, 0, SpectrSize * sizeof(fftw_complex));
-  plan = fftw_plan_dft_1d(SpectrSize, input, output, FFTW_FORWARD, FFTW_MEASURE);
+  };
+  auto want = makeWant();
+  // a lane per channel of every capture device
+  const auto makeAnalyzer = []() {
+    return std::make_unique<Analyzer>(
+      config().stftParams(),
+      config().channels * std::max(static_cast<int>(config().devices.size()), 1));
+  };
+  auto analyzer = makeAnalyzer();
+  rend.setLanes(analyzer->lanesNum());
+  // the spectra and the notes of the lanes for the renderer, refilled every frame
+  std::vector<const std::vector<float> *> spectra(analyzer->lanesNum());
+  std::vector<const std::vector<float> *> notes(analyzer->lanesNum());
+  // the note events go to the file of the config, reopened when a reload changes it
+  std::string notesPath;
+  FILE *notesFile = nullptr;
+  const auto openNotes = [&notesPath, &notesFile]() {
+    if (config().noteEvents == notesPath)
+      return;
+    if (notesFile && notesFile != stdout)
+      fclose(notesFile);
+    notesPath = config().noteEvents;
+    notesFile = notesPath.empty() ? nullptr : notesPath == "-" ? stdout : fopen(notesPath.c_str(), "a");
+    if (!notesPath.empty() && !notesFile)
+      LOG("Could not open", notesPath);
+  };
+  openNotes();
 
-  const auto fps = 30;
-  auto capture = std::unique_ptr<sdl::Audio>{};
+  FrameScheduler scheduler(Pacing::Fixed, 30, 2);
+  SDL_GL_SetSwapInterval(scheduler.vsync() ? 1 : 0);
+  std::vector<std::unique_ptr<sdl::Audio>> captures;
   float playFreq = 440;
   float playVol = 0.f;
   SDL_AudioSpec have;
   auto audio =
-    sdl::Audio{nullptr, false, &want, &have, 0, [&playFreq, &playVol](Uint8 *stream, int len) {
+    sdl::Audio{nullptr, false, &want, &have, 0, [&playFreq, &playVol, &have](Uint8 *stream, int len) {
                  static double pos = 0;
                  static float vol = 0;
-                 for (auto i = 0U; i < len / sizeof(int16_t); ++i)
+                 // the spec follows the capture channels, every channel of a frame gets the same sample
+                 const auto channels = std::max<int>(have.channels, 1);
+                 auto *out = reinterpret_cast<int16_t *>(stream);
+                 for (auto f = 0U; f < len / sizeof(int16_t) / channels; ++f)
                  {
                    if (playVol > vol)
                      vol = playVol;
                    else
                      vol = vol - 0.0002 * (vol - playVol);
-                   pos += 1.f * playFreq * 2 * 3.1415926 / SampleFreq;
-                   reinterpret_cast<int16_t *>(stream)[i] =
-                     static_cast<int16_t>(vol * 0x8000 * (sin(pos) > 0 ? 1 : -1));
+                   pos += 1.f * playFreq * 2 * 3.1415926 / have.freq;
+                   const auto v = static_cast<int16_t>(vol * 0x8000 * (sin(pos) > 0 ? 1 : -1));
+                   std::fill(out + f * channels, out + (f + 1) * channels, v);
                  }
                }};
   audio.pause(false);
   e.mouseMotion = [&playVol, &playFreq](const SDL_MouseMotionEvent &e) {
     if (playVol > 0)
       playVol = expf(-0.0045f * e.y);
-    playFreq = StartFreq * expf(1.f * e.x / Width * logf(1.f * EndFreq / StartFreq));
+    const auto &c = config();
+    playFreq = c.startFreq * expf(1.f * e.x / c.width * logf(c.endFreq / c.startFreq));
   };
   e.mouseButtonDown = [&playVol, &playFreq](const SDL_MouseButtonEvent &e) {
     playVol = expf(-0.0045f * e.y);
-    playFreq = StartFreq * expf(1.f * e.x / Width * logf(1.f * EndFreq / StartFreq));
+    const auto &c = config();
+    playFreq = c.startFreq * expf(1.f * e.x / c.width * logf(c.endFreq / c.startFreq));
   };
   e.mouseButtonUp = [&playVol](const SDL_MouseButtonEvent &) { playVol = 0.f; };
 
   SDL_Keycode lastKey;
-  bool smartScale = false;
-  e.keyDown = [&playVol, &playFreq, &lastKey, &smartScale](const SDL_KeyboardEvent &e) {
+  auto showHud = false;
+  auto reload = false;
+  auto renderAllocs = 0ULL;
+  e.keyDown = [&playVol, &playFreq, &lastKey, &showHud, &reload, &analyzer, &scheduler, &rend, profilePath](
+                const SDL_KeyboardEvent &e) {
     int note = -1;
     lastKey = e.keysym.sym;
     switch (e.keysym.sym)
@@ -136,7 +255,50 @@ int main(int argc, const char *argv[])
     case SDLK_PERIOD: note = 24 + 2; break;
     case SDLK_SEMICOLON: note = 24 + 3; break;
     case SDLK_SLASH: note = 24 + 4; break;
-    case SDLK_TAB: smartScale = !smartScale; break;
+    case SDLK_TAB:
+      analyzer->setEnvelope(static_cast<Envelope>((static_cast<int>(analyzer->envelope()) + 1) %
+                                                  static_cast<int>(Envelope::Count)));
+      LOG("Smart scale:", toString(analyzer->envelope()));
+      break;
+    case SDLK_F1:
+      analyzer->setWeighting(static_cast<Weighting>((static_cast<int>(analyzer->weighting()) + 1) %
+                                                    static_cast<int>(Weighting::Count)));
+      LOG("Weighting:", toString(analyzer->weighting()));
+      break;
+    case SDLK_F2:
+      analyzer->setTransform(static_cast<Transform>((static_cast<int>(analyzer->transform()) + 1) %
+                                                    static_cast<int>(Transform::Count)));
+      LOG("Transform:", toString(analyzer->transform()));
+      break;
+    case SDLK_F3:
+      if (analyzer->isRecording())
+      {
+        analyzer->stopRecording();
+        LOG("Recording stopped");
+      }
+      else
+      {
+        const auto path = "spectrogram-" + std::to_string(time(nullptr)) + ".spgr";
+        analyzer->startRecording(path);
+        LOG("Recording to", path);
+      }
+      break;
+    case SDLK_F4:
+      scheduler.setPacing(static_cast<Pacing>((static_cast<int>(scheduler.pacing()) + 1) %
+                                              static_cast<int>(Pacing::Count)));
+      SDL_GL_SetSwapInterval(scheduler.vsync() ? 1 : 0);
+      LOG("Pacing:", toString(scheduler.pacing()));
+      break;
+    case SDLK_F5:
+      showHud = !showHud;
+      Profiler::instance().setEnabled(showHud || profilePath);
+      break;
+    case SDLK_F6: reload = true; break;
+    case SDLK_F7:
+      rend.setLayout(
+        static_cast<Layout>((static_cast<int>(rend.layout()) + 1) % static_cast<int>(Layout::Count)));
+      LOG("Layout:", toString(rend.layout()));
+      break;
     }
     if (note >= 0)
     {
@@ -149,67 +311,171 @@ int main(int argc, const char *argv[])
       playVol = 0.0f;
   };
 
+  auto rendTransform = Transform::Fft;
   while (!done)
   {
     static auto audioCaptureTime = SDL_GetTicks();
     static auto samples = 0LL;
-    if (std::abs(audioCaptureTime + samples * 1000 / SampleFreq - SDL_GetTicks()) > 1000)
+    if (reload)
+    {
+      reload = false;
+      try
+      {
+        const auto cfg = loadConfig();
+        cfg.validate();
+        // the capture callbacks and the analysis thread are stopped while the config changes
+        captures.clear();
+        const auto weighting = analyzer->weighting();
+        const auto transform = analyzer->transform();
+        const auto envelope = analyzer->envelope();
+        analyzer = nullptr;
+        setConfig(cfg);
+        analyzer = makeAnalyzer();
+        analyzer->setWeighting(weighting);
+        analyzer->setTransform(transform);
+        analyzer->setEnvelope(envelope);
+        want = makeWant();
+        SDL_SetWindowSize(w.get(), cfg.width, cfg.height);
+        rend.applyConfig();
+        rendTransform = Transform::Fft;
+        rend.setFreqs(analyzer->freqs(rendTransform));
+        rend.setLanes(analyzer->lanesNum());
+        spectra.resize(analyzer->lanesNum());
+        notes.resize(analyzer->lanesNum());
+        openNotes();
+        scheduler = FrameScheduler(scheduler.pacing(), 30, 2);
+        LOG("Config applied");
+      }
+      catch (int)
+      {
+        LOG("Config is not applied");
+      }
+    }
+    // the first device paces the check, a stalled one restarts all of them
+    if (std::abs(audioCaptureTime + samples * 1000 / config().sampleFreq - SDL_GetTicks()) > 1000)
     {
       LOG("Restart recording");
-      capture = nullptr;
+      captures.clear();
     }
-    if (!capture)
+    if (captures.empty())
     {
-      SDL_AudioSpec captureHave;
       audioCaptureTime = SDL_GetTicks();
       samples = 0;
-      capture =
-        std::make_unique<sdl::Audio>(nullptr, true, &want, &captureHave, 0, [](Uint8 *stream, int len) {
-          static std::size_t pos = 0;
-          static std::vector<int16_t> rawInput;
-          rawInput.resize(SpectrSize);
-          for (auto i = 0U; i < len / sizeof(int16_t); ++i)
-          {
-            rawInput[pos] = reinterpret_cast<int16_t *>(stream)[i];
-            input[pos++][1] = 0;
-            if (pos >= rawInput.size())
-              pos = 0;
-          }
-
-          for (auto i = 0U; i < SpectrSize; ++i)
-          {
-            input[i][0] = expf(-0.00025f * (SpectrSize - i)) * rawInput[(pos + i) % rawInput.size()];
-            input[i][1] = 0;
-          }
-
-          fftw_execute(plan);
-          std::lock_guard<std::mutex> lock(mutex);
-          spectr.clear();
-          for (auto j = 0U; j < SpectrSize / 2; ++j)
-            spectr.push_back(elcK(j * SampleFreq / SpectrSize) *
-                             sqrt((output[j][0] * output[j][0] + output[j][1] * output[j][1])));
-          samples += len / sizeof(int16_t);
-        });
-      capture->pause(false);
+      const auto &devices = config().devices;
+      const auto channels = config().channels;
+      for (auto d = 0; d < std::max(static_cast<int>(devices.size()), 1); ++d)
+      {
+        SDL_AudioSpec captureHave;
+        captures.push_back(std::make_unique<sdl::Audio>(
+          devices.empty() ? nullptr : devices[d].c_str(),
+          true,
+          &want,
+          &captureHave,
+          0,
+          [&analyzer, d, channels](Uint8 *stream, int len) {
+            const auto size = len / sizeof(int16_t);
+            analyzer->push(reinterpret_cast<int16_t *>(stream), size, d * channels, channels);
+            if (d == 0)
+              samples += size / channels;
+          }));
+        captures.back()->pause(false);
+      }
     }
 
-    const auto t1 = SDL_GetTicks();
     while (e.poll()) {}
     {
-      std::lock_guard<std::mutex> lock(mutex);
-      if (!spectr.empty())
+      NoteEvent events[64];
+      auto isWritten = false;
+      while (const auto n = analyzer->popNoteEvents(events, std::size(events)))
+      {
+        if (!notesFile)
+          continue;
+        for (auto i = 0U; i < n; ++i)
+          write(notesFile, events[i]);
+        isWritten = true;
+      }
+      if (isWritten)
+        fflush(notesFile);
+    }
+    // the lanes switch the transform in the same tick, but update() may land in the middle of it
+    const auto isConsistent = [&analyzer]() {
+      for (auto i = 1; i < analyzer->lanesNum(); ++i)
+        if (analyzer->spectr(i).transform != analyzer->spectr().transform)
+          return false;
+      return true;
+    };
+    if (analyzer->update() && isConsistent())
+    {
+      const auto &frame = analyzer->spectr();
+      if (frame.transform != rendTransform)
       {
-        rend.rend(std::move(spectr), smartScale);
-        w.glSwap();
+        rendTransform = frame.transform;
+        rend.setFreqs(analyzer->freqs(frame.transform));
+      }
+      {
+        // Rend sizes its buffers and profiler sections in applyConfig(), setLanes() and setFreqs(),
+        // from the first frame after them on a frame must not allocate
+        AllocScope allocs(true);
+        for (auto i = 0; i < analyzer->lanesNum(); ++i)
+        {
+          spectra[i] = &analyzer->spectr(i).spectr;
+          notes[i] = &analyzer->spectr(i).notes;
+        }
+        rend.rend(spectra, notes, frame.envelope != Envelope::None);
+        renderAllocs += allocs.count();
+      }
+      w.glSwap();
+      static auto isFirstFrame = true;
+      if (isFirstFrame)
+      {
+        isFirstFrame = false;
+        LOG("Startup time:",
+            std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - startTime).count(),
+            "ms");
       }
     }
-    const auto t2 = SDL_GetTicks();
-    if (1000 / fps > t2 - t1)
-      SDL_Delay(1000 / fps - (t2 - t1));
+    {
+      // report the capture/analysis health every 10 seconds
+      static auto reportTime = SDL_GetTicks();
+      if (SDL_GetTicks() - reportTime > 10000)
+      {
+        reportTime = SDL_GetTicks();
+        LOG("Analysis underruns:",
+            analyzer->underruns(),
+            "overruns:",
+            analyzer->overruns(),
+            "frame:",
+            analyzer->frameTime(),
+            "us, dropped frames:",
+            analyzer->droppedFrames(),
+            "repeated frames:",
+            analyzer->repeatedFrames(),
+            "upload:",
+            rend.uploaded(),
+            "bytes/frame, render allocations:",
+            renderAllocs,
+            scheduler.isIdle() ? "idle" : "");
+      }
+    }
+    if (showHud)
+    {
+      // timings of the render and analysis sections on stdout once a second
+      static auto hudTime = SDL_GetTicks();
+      if (SDL_GetTicks() - hudTime > 1000)
+      {
+        hudTime = SDL_GetTicks();
+        printf("%s\n", Profiler::instance().report().c_str());
+      }
+    }
+    scheduler.wait(analyzer->peak() < SilenceLevel);
   }
-  capture->pause(true);
-
-  fftw_destroy_plan(plan);
-  fftw_free(input);
-  fftw_free(output);
+  if (profilePath)
+    Profiler::instance().dump(profilePath);
+  // the index of the recording is written after the last frame
+  analyzer->stopRecording();
+  Recorder::waitClosed();
+  for (auto &capture : captures)
+    capture->pause(true);
+  if (notesFile && notesFile != stdout)
+    fclose(notesFile);
 }
@@ -0,0 +1,155 @@
+#include "multi_resolution.hpp"
+#include "profiler.hpp"
+#include "simd.hpp"
+#include <cmath>
+#include <tuple>
+
+namespace
+{
+  // The half-band filter passes up to 0.2 of its input rate and stops from 0.3, the aliases land
+  // above 0.4 of the output rate. Every band is clean up to 0.4 of its own rate and covers the
+  // octave from 0.2 of it, the band above takes over from there.
+  const auto BandStart = 0.2f;
+  // Blackman windowed sinc, the transition is about 5.5 / TapsNum wide
+  const auto TapsNum = 55;
+  const auto MinFftSize = 64;
+
+  struct Layout
+  {
+    int bandsNum;
+    int fftSize;
+  };
+
+  // bands are added until the lowest one reaches minFreq, a band needs a whole number of samples
+  // per hop
+  auto layout(MultiResolutionParams p) -> Layout
+  {
+    auto n = 1;
+    while (BandStart * p.sampleFreq / (1 << (n - 1)) > p.minFreq && p.hopSize % (1 << n) == 0 &&
+           (p.fftSize >> n) >= MinFftSize)
+      ++n;
+    return {n, p.fftSize >> (n - 1)};
+  }
+
+  auto bandRate(MultiResolutionParams p, int band) -> float
+  {
+    return 1.f * p.sampleFreq / (1 << band);
+  }
+
+  // bins [from, to) of the band, the top band goes up to the Nyquist frequency and the lowest one
+  // down to minFreq
+  auto bandBins(MultiResolutionParams p, Layout l, int band) -> std::pair<int, int>
+  {
+    auto from = static_cast<int>(ceilf(BandStart * l.fftSize));
+    auto to = band == 0 ? l.fftSize / 2 : 2 * from;
+    if (band == l.bandsNum - 1)
+      from = std::clamp(static_cast<int>(p.minFreq * l.fftSize / bandRate(p, band)), 1, to - 1);
+    return {from, to};
+  }
+} // namespace
+
+auto MultiResolution::binFreqs(MultiResolutionParams p) -> std::vector<float>
+{
+  const auto l = layout(p);
+  std::vector<float> res;
+  for (auto b = l.bandsNum - 1; b >= 0; --b)
+  {
+    const auto range = bandBins(p, l, b);
+    for (auto k = range.first; k < range.second; ++k)
+      res.push_back(k * bandRate(p, b) / l.fftSize);
+  }
+  return res;
+}
+
+MultiResolution::Band::Band(StftParams p) : stft(p), history(2 * TapsNum), decimated(p.hopSize / 2 + 1) {}
+
+MultiResolution::MultiResolution(MultiResolutionParams p) : hopSize(p.hopSize)
+{
+  const auto l = layout(p);
+  for (auto b = 0; b < l.bandsNum; ++b)
+  {
+    bands.push_back(std::make_unique<Band>(StftParams{l.fftSize, l.fftSize, p.hopSize >> b, WindowType::Hann}));
+    auto &band = *bands.back();
+    std::tie(band.from, band.to) = bandBins(p, l, b);
+    // the windows of the Stft are scaled to the level of their own size
+    band.level = windowLevel(p.fftSize) / windowLevel(l.fftSize);
+    binsNum += band.to - band.from;
+  }
+  const auto center = TapsNum / 2;
+  auto sum = 0.;
+  for (auto m = 1; m <= center; m += 2)
+  {
+    const auto x = 2 * M_PI * (center + m) / (TapsNum - 1);
+    const auto blackman = 0.42 - 0.5 * cos(x) + 0.08 * cos(2 * x);
+    taps.push_back(sin(M_PI * m / 2) / (M_PI * m) * blackman);
+    sum += taps.back();
+  }
+  // unity gain at DC with the center tap of 0.5
+  for (auto &t : taps)
+    t *= 0.25 / sum;
+}
+
+auto MultiResolution::reset() -> void
+{
+  sinceFrame = 0;
+  for (auto &band : bands)
+  {
+    band->stft.reset();
+    band->bins = nullptr;
+    std::fill(std::begin(band->history), std::end(band->history), 0.f);
+    band->pos = 0;
+    band->isOdd = false;
+  }
+}
+
+auto MultiResolution::append(const int16_t *samples, int size) -> void
+{
+  for (auto b = 0; b < bandsNum(); ++b)
+  {
+    auto &band = *bands[b];
+    band.stft.push(samples, size, [&band](const fftwf_complex *bins) { band.bins = bins; });
+    if (b + 1 == bandsNum())
+      break;
+    ScopedTimer timer("decimation");
+    size = decimate(band, samples, size);
+    samples = band.decimated.data();
+  }
+}
+
+auto MultiResolution::decimate(Band &band, const int16_t *samples, int size) -> int
+{
+  auto res = 0;
+  for (auto i = 0; i < size; ++i)
+  {
+    band.history[band.pos] = band.history[band.pos + TapsNum] = samples[i];
+    band.pos = (band.pos + 1) % TapsNum;
+    band.isOdd = !band.isOdd;
+    if (band.isOdd)
+      continue;
+    // the last TapsNum samples, the oldest first; the taps are symmetric and every second one is 0
+    const auto *center = band.history.data() + band.pos + TapsNum / 2;
+    auto y = 0.5f * center[0];
+    for (auto t = 0; t < static_cast<int>(taps.size()); ++t)
+      y += taps[t] * (center[-(2 * t + 1)] + center[2 * t + 1]);
+    band.decimated[res++] = static_cast<int16_t>(std::clamp(lroundf(y), -0x8000L, 0x7fffL));
+  }
+  return res;
+}
+
+auto MultiResolution::apply(const float *gain, float *out) const -> void
+{
+  for (auto b = bandsNum() - 1; b >= 0; --b)
+  {
+    const auto &band = *bands[b];
+    const auto n = band.to - band.from;
+    if (band.bins)
+    {
+      Simd::magnitude(band.bins + band.from, gain, out, n);
+      Simd::scale(out, band.level, out, n);
+    }
+    else
+      std::fill(out, out + n, 0.f);
+    gain += n;
+    out += n;
+  }
+}
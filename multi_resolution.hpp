@@ -0,0 +1,79 @@
+#pragma once
+#include "stft.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+struct MultiResolutionParams
+{
+  float minFreq;
+  // the lowest band resolves as finely as a single FFT of this size at the full rate
+  int fftSize;
+  int hopSize;
+  int sampleFreq;
+};
+
+// Octave band analysis. Half-band filters halve the sample rate band after band and every band
+// runs the same small FFT, so each window is only as long as the resolution of its octave needs:
+// the lowest band looks as far back as the full size FFT, the top octaves a few milliseconds.
+// The bins of the octaves are stitched in one ascending frame of about constant bins per octave.
+class MultiResolution
+{
+public:
+  MultiResolution(MultiResolutionParams);
+  static auto binFreqs(MultiResolutionParams) -> std::vector<float>;
+  auto size() const -> int { return binsNum; }
+  auto bandsNum() const -> int { return static_cast<int>(bands.size()); }
+  // zeroes the sample history of all the bands
+  auto reset() -> void;
+  // calls onFrame() for every completed hop, then apply() gives the frame
+  template <typename F>
+  auto push(const int16_t *samples, int size, F &&onFrame) -> void
+  {
+    while (size > 0)
+    {
+      const auto n = std::min(size, hopSize - sinceFrame);
+      append(samples, n);
+      samples += n;
+      size -= n;
+      sinceFrame += n;
+      if (sinceFrame == hopSize)
+      {
+        sinceFrame = 0;
+        onFrame();
+      }
+    }
+  }
+  // out[k] = gain[k] * |bin k|, a sinusoid peaks at the level of the full size FFT in every band
+  auto apply(const float *gain, float *out) const -> void;
+
+private:
+  struct Band
+  {
+    Band(StftParams);
+    Stft stft;
+    // bins of the last frame, the ones in [from, to) are the octave of the band
+    const fftwf_complex *bins = nullptr;
+    int from;
+    int to;
+    float level;
+    // the last taps inputs twice, so the filter always reads them contiguously
+    std::vector<float> history;
+    int pos = 0;
+    bool isOdd = false;
+    // input of the next band
+    std::vector<int16_t> decimated;
+  };
+
+  auto append(const int16_t *samples, int size) -> void;
+  auto decimate(Band &, const int16_t *samples, int size) -> int;
+
+  int hopSize;
+  int sinceFrame = 0;
+  int binsNum = 0;
+  // the top band at the full rate first
+  std::vector<std::unique_ptr<Band>> bands;
+  // the nonzero taps of the half-band filter right of the center one
+  std::vector<float> taps;
+};
@@ -0,0 +1,213 @@
+#include "offline.hpp"
+#include "config.hpp"
+#include "elc.hpp"
+#include "pcm_reader.hpp"
+#include "png_writer.hpp"
+#include "spectral_norm.hpp"
+#include "stft.hpp"
+#include "thread_pool.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <log/log.hpp>
+#include <memory>
+#include <string>
+#include <thread>
+
+namespace
+{
+  // Per-thread analysis state, every lane has its own FFT plan and buffers
+  struct Lane
+  {
+    Lane(const std::vector<float> &freqs, float frameRate)
+      : stft(config().stftParams()),
+        norm(freqs, frameRate),
+        samples(config().stftParams().windowSize),
+        spectr(freqs.size()),
+        ys(freqs.size())
+    {
+    }
+    Stft stft;
+    SpectralNorm norm;
+    std::vector<int16_t> samples;
+    std::vector<float> spectr;
+    std::vector<float> ys;
+  };
+
+  class Output
+  {
+  public:
+    Output(const std::string &path, const float *freqs, int width, int height, int rate)
+      : width(width), row(width)
+    {
+      if (path.size() >= 4 && path.compare(path.size() - 4, 4, ".png") == 0)
+        png = std::make_unique<PngWriter>(path, width, height, 1);
+      else
+      {
+        bin = fopen(path.c_str(), "wb");
+        if (!bin)
+        {
+          LOG("Could not create", path);
+          throw -16;
+        }
+        // "SPGM", version, number of bins, sample rate, FFT size, hop size (uint32 each), bin
+        // frequencies (float32 each), then normalized frames of float32 bins until the end of the file
+        fwrite("SPGM", 1, 4, bin);
+        const uint32_t header[] = {1,
+                                   static_cast<uint32_t>(width),
+                                   static_cast<uint32_t>(rate),
+                                   static_cast<uint32_t>(config().spectrSize),
+                                   static_cast<uint32_t>(config().hopSize)};
+        fwrite(header, sizeof(header[0]), std::size(header), bin);
+        fwrite(freqs, sizeof(float), width, bin);
+      }
+    }
+    ~Output()
+    {
+      if (bin)
+        fclose(bin);
+    }
+    auto write(const float *ys) -> void
+    {
+      if (png)
+      {
+        for (auto i = 0; i < width; ++i)
+          row[i] = static_cast<uint8_t>(std::clamp(ys[i], 0.f, 1.f) * 255.f);
+        png->addRow(row.data());
+      }
+      else
+        fwrite(ys, sizeof(float), width, bin);
+    }
+
+  private:
+    int width;
+    std::vector<uint8_t> row;
+    std::unique_ptr<PngWriter> png;
+    FILE *bin = nullptr;
+  };
+} // namespace
+
+auto offlineUsage() -> const char *
+{
+  return "<input.wav|input.raw> <output.png|output.bin> [--smart-scale] "
+         "[--envelope <off|iir|cepstral|min-track|poly>] [--rate <raw sample rate>] [--threads <n>] "
+         "[--config <file>] [--<config option> <value>]";
+}
+
+auto offline(int argc, const char *argv[]) -> int
+{
+  if (argc < 4)
+  {
+    fprintf(stderr, "Usage: %s --offline %s\n", argv[0], offlineUsage());
+    return 1;
+  }
+  const std::string input = argv[2];
+  const std::string output = argv[3];
+  auto envelope = Envelope::None;
+  auto cfg = config();
+  auto rawRate = cfg.sampleFreq;
+  auto threads = static_cast<int>(std::thread::hardware_concurrency());
+  for (auto i = 4; i < argc; ++i)
+    if (strcmp(argv[i], "--smart-scale") == 0)
+      envelope = Envelope::Iir;
+    else if (strcmp(argv[i], "--envelope") == 0 && i + 1 < argc)
+      envelope = toEnvelope(argv[++i]);
+    else if (strcmp(argv[i], "--rate") == 0 && i + 1 < argc)
+      rawRate = std::stoi(argv[++i]);
+    else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+      threads = std::stoi(argv[++i]);
+    else if (const auto n = cfg.parse(argv[i], i + 1 < argc ? argv[i + 1] : nullptr))
+      i += n - 1;
+  setConfig(cfg);
+  if (envelope == Envelope::MinTrack && threads > 1)
+  {
+    // the noise floor depends on all the frames before, the lanes would each see a part of them
+    LOG("The min-track envelope runs on one thread");
+    threads = 1;
+  }
+  const auto spectrSize = cfg.spectrSize;
+  const auto windowSize = cfg.stftParams().windowSize;
+  const auto hopSize = cfg.hopSize;
+
+  PcmReader reader(input, rawRate);
+  const auto rate = reader.sampleFreq();
+  const ElcTable elc(Weighting::Elc60, spectrSize, rate);
+  std::vector<float> freqs;
+  for (auto i = 0; i < spectrSize / 2; ++i)
+    freqs.push_back(1.f * i * rate / spectrSize);
+  // only the displayed range is written out
+  const auto from = std::lower_bound(std::begin(freqs), std::end(freqs), cfg.startFreq) - std::begin(freqs);
+  const auto to = std::lower_bound(std::begin(freqs), std::end(freqs), cfg.endFreq) - std::begin(freqs);
+  const auto width = static_cast<int>(to - from);
+  const auto height = static_cast<int64_t>(reader.size() / hopSize);
+  Output out(output, freqs.data() + from, width, height, rate);
+
+  const auto analyze = [&](Lane &lane, const fftwf_complex *bins, float *row) {
+    elc.apply(bins, lane.spectr.data(), lane.spectr.size());
+    lane.norm.apply(lane.spectr.data(), lane.ys.data(), envelope);
+    std::copy(lane.ys.data() + from, lane.ys.data() + to, row);
+  };
+
+  const auto t1 = std::chrono::steady_clock::now();
+  if (threads <= 1)
+  {
+    Lane lane(freqs, 1.f * rate / hopSize);
+    std::vector<float> row(width);
+    std::vector<int16_t> chunk(1 << 16);
+    while (const auto n = reader.read(chunk.data(), chunk.size()))
+      lane.stft.push(chunk.data(), n, [&](const fftwf_complex *bins) {
+        analyze(lane, bins, row.data());
+        out.write(row.data());
+      });
+  }
+  else
+  {
+    // All the lanes execute the one shared FFT plan, so every thread runs exactly the same FFT
+    // algorithm: the output is bit identical to the serial path.
+    ThreadPool pool(threads);
+    std::vector<std::unique_ptr<Lane>> lanes;
+    for (auto i = 0; i < pool.size(); ++i)
+      lanes.push_back(std::make_unique<Lane>(freqs, 1.f * rate / hopSize));
+    // frames are computed a block at a time into the preallocated matrix and then written out in
+    // order, the memory use does not depend on the file length
+    const auto blockSize = int64_t{4096};
+    std::vector<float> matrix(blockSize * width);
+    for (auto block = int64_t{0}; block < height; block += blockSize)
+    {
+      const auto blockEnd = std::min(height, block + blockSize);
+      pool.parallelFor(block, blockEnd, 16, [&](int64_t begin, int64_t end, int worker) {
+        auto &lane = *lanes[worker];
+        for (auto frame = begin; frame < end; ++frame)
+        {
+          // frame k covers the window ending after hop k + 1, the stream starts with silence
+          const auto last = (frame + 1) * hopSize;
+          const auto first = last - windowSize;
+          const auto silence = static_cast<std::size_t>(std::max<int64_t>(0, -first));
+          std::fill(lane.samples.data(), lane.samples.data() + silence, 0);
+          reader.read(std::max<int64_t>(0, first), lane.samples.data() + silence, windowSize - silence);
+          analyze(lane, lane.stft.frame(lane.samples.data()), matrix.data() + (frame - block) * width);
+        }
+      });
+      for (auto frame = block; frame < blockEnd; ++frame)
+        out.write(matrix.data() + (frame - block) * width);
+      reader.release(std::max<int64_t>(0, blockEnd * hopSize - windowSize));
+    }
+  }
+  const auto t2 = std::chrono::steady_clock::now();
+
+  const auto secs = std::chrono::duration<double>(t2 - t1).count();
+  LOG("Frames:",
+      height,
+      "threads:",
+      threads,
+      "time:",
+      secs,
+      "s",
+      "throughput:",
+      height / secs,
+      "frames/s",
+      1.0 * height * hopSize / rate / secs,
+      "x real time");
+  return 0;
+}
@@ -0,0 +1,7 @@
+#pragma once
+
+// Headless batch analysis: spectrogram --offline <input.wav|input.raw> <output.png|output.bin>
+// [--smart-scale] [--envelope <off|iir|cepstral|min-track|poly>] [--rate <raw sample rate>] [--threads <n>] [--config <file>] [--<config option> <value>]
+auto offline(int argc, const char *argv[]) -> int;
+// the arguments after --offline
+auto offlineUsage() -> const char *;
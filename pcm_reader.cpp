@@ -0,0 +1,155 @@
+#include "pcm_reader.hpp"
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <log/log.hpp>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static auto u16(const uint8_t *p) -> uint32_t
+{
+  return p[0] | (p[1] << 8);
+}
+
+static auto u32(const uint8_t *p) -> uint32_t
+{
+  return p[0] | (p[1] << 8) | (p[2] << 16) | (static_cast<uint32_t>(p[3]) << 24);
+}
+
+PcmReader::PcmReader(const std::string &path, int rawSampleFreq) : freq(rawSampleFreq)
+{
+  fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+  {
+    LOG("Could not open", path);
+    throw -10;
+  }
+  struct stat st;
+  fstat(fd, &st);
+  fileSize = st.st_size;
+  if (fileSize > 0)
+  {
+    auto ptr = mmap(nullptr, fileSize, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (ptr == MAP_FAILED)
+    {
+      LOG("Could not map", path);
+      close(fd);
+      throw -11;
+    }
+    file = static_cast<const uint8_t *>(ptr);
+    madvise(ptr, fileSize, MADV_SEQUENTIAL);
+  }
+  if (!parseWav())
+  {
+    data = file;
+    frames = fileSize / 2;
+  }
+}
+
+PcmReader::~PcmReader()
+{
+  if (file)
+    munmap(const_cast<uint8_t *>(file), fileSize);
+  close(fd);
+}
+
+auto PcmReader::parseWav() -> bool
+{
+  if (fileSize < 12 || memcmp(file, "RIFF", 4) != 0 || memcmp(file + 8, "WAVE", 4) != 0)
+    return false;
+  auto isFmt = false;
+  for (auto p = file + 12; p + 8 <= file + fileSize;)
+  {
+    const auto chunkSize = u32(p + 4);
+    const auto body = p + 8;
+    if (memcmp(p, "fmt ", 4) == 0 && chunkSize >= 16)
+    {
+      auto format = u16(body);
+      channels = u16(body + 2);
+      freq = u32(body + 4);
+      bytesPerSample = u16(body + 14) / 8;
+      // WAVE_FORMAT_EXTENSIBLE keeps the actual format in the sub-format GUID
+      if (format == 0xfffe && chunkSize >= 26)
+        format = u16(body + 24);
+      isFloat = format == 3;
+      if ((format != 1 && format != 3) || channels < 1 || bytesPerSample < 1 || bytesPerSample > 4 ||
+          (isFloat && bytesPerSample != 4))
+      {
+        LOG("Unsupported WAV format", format, "bits per sample", bytesPerSample * 8);
+        throw -12;
+      }
+      isFmt = true;
+    }
+    else if (memcmp(p, "data", 4) == 0)
+    {
+      if (!isFmt)
+      {
+        LOG("WAV data chunk before fmt chunk");
+        throw -13;
+      }
+      data = body;
+      // streaming writers leave the size unset
+      const auto size = std::min<std::size_t>(chunkSize, file + fileSize - body);
+      frames = size / (channels * bytesPerSample);
+      return true;
+    }
+    p = body + chunkSize + (chunkSize & 1);
+  }
+  LOG("WAV file without data chunk");
+  throw -14;
+}
+
+auto PcmReader::sample(std::size_t frame) const -> int16_t
+{
+  auto p = data + frame * channels * bytesPerSample;
+  auto sum = 0;
+  for (auto c = 0; c < channels; ++c, p += bytesPerSample)
+  {
+    if (isFloat)
+    {
+      float f;
+      memcpy(&f, p, sizeof(f));
+      sum += static_cast<int>(std::clamp(f, -1.f, 1.f) * 0x7fff);
+    }
+    else
+      switch (bytesPerSample)
+      {
+      case 1: sum += (p[0] - 0x80) << 8; break;
+      case 2: sum += static_cast<int16_t>(u16(p)); break;
+      case 3:
+      case 4: sum += static_cast<int16_t>(u16(p + bytesPerSample - 2)); break;
+      }
+  }
+  return static_cast<int16_t>(sum / channels);
+}
+
+auto PcmReader::read(std::size_t from, int16_t *dst, std::size_t size) const -> std::size_t
+{
+  size = std::min(size, frames - std::min(from, frames));
+  if (channels == 1 && bytesPerSample == 2 && !isFloat)
+    memcpy(dst, data + from * 2, size * 2);
+  else
+    for (auto i = 0U; i < size; ++i)
+      dst[i] = sample(from + i);
+  return size;
+}
+
+auto PcmReader::read(int16_t *dst, std::size_t size) -> std::size_t
+{
+  const auto res = read(pos, dst, size);
+  pos += res;
+  release(pos);
+  return res;
+}
+
+auto PcmReader::release(std::size_t sample) -> void
+{
+  const auto page = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+  const auto consumed = (data - file + sample * channels * bytesPerSample) / page * page;
+  if (consumed > releasedPos + (64 << 20))
+  {
+    madvise(const_cast<uint8_t *>(file) + releasedPos, consumed - releasedPos, MADV_DONTNEED);
+    releasedPos = consumed;
+  }
+}
@@ -0,0 +1,44 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Memory mapped PCM file, either WAV (8/16/24/32-bit integer or 32-bit float, any number of
+// channels) or headerless signed 16-bit little-endian mono. Samples are mixed down to mono 16-bit
+// on the fly, so the file never has to fit in RAM.
+class PcmReader
+{
+public:
+  // files without the RIFF header are read as raw PCM at rawSampleFreq
+  PcmReader(const std::string &path, int rawSampleFreq);
+  ~PcmReader();
+  PcmReader(const PcmReader &) = delete;
+  PcmReader &operator=(const PcmReader &) = delete;
+  auto sampleFreq() const -> int { return freq; }
+  // number of mono samples
+  auto size() const -> std::size_t { return frames; }
+  // reads up to size samples from the current position, returns the number of samples read
+  auto read(int16_t *dst, std::size_t size) -> std::size_t;
+  // reads up to size samples starting from the given sample, does not move the current position
+  auto read(std::size_t pos, int16_t *dst, std::size_t size) const -> std::size_t;
+  // lets the kernel drop the pages before the given sample, keeps the resident size bounded on
+  // long files; read() does it automatically
+  auto release(std::size_t sample) -> void;
+
+private:
+  auto parseWav() -> bool;
+  auto sample(std::size_t frame) const -> int16_t;
+
+  int fd = -1;
+  const uint8_t *file = nullptr;
+  std::size_t fileSize = 0;
+  const uint8_t *data = nullptr;
+  std::size_t frames = 0;
+  int freq;
+  int channels = 1;
+  int bytesPerSample = 2;
+  bool isFloat = false;
+  std::size_t pos = 0;
+  // file offset up to which the pages were released
+  std::size_t releasedPos = 0;
+};
@@ -0,0 +1,197 @@
+#include "pitch_tracker.hpp"
+#include "config.hpp"
+#include "consts.hpp"
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+  const auto Harmonics = 8;
+  const auto MaxPolyphony = 6;
+  // a key is found if its salience is this far above the one of the noise floor
+  const auto MinConfidence = 0.6f;
+  // and at least this share of the salience of the strongest note of the frame
+  const auto MinShare = 0.3f;
+  // level of the quietest fundamental, in the units of the unweighted spectrum
+  const auto MinLevel = 2e+3f;
+  // how long a key has to be found to turn on and missed to turn off, seconds
+  const auto OnTime = 0.04f;
+  const auto OffTime = 0.06f;
+
+  // semitones from 55 Hz
+  auto toSemitone(float freq) -> float
+  {
+    return 12.f * log2f(freq / 55.f);
+  }
+} // namespace
+
+auto noteName(int key) -> std::string
+{
+  static const char *names[] = {"A", "A#", "B", "C", "C#", "D", "D#", "E", "F", "F#", "G", "G#"};
+  // octaves start at C
+  return names[key % 12] + std::to_string((key + 9) / 12 + 1);
+}
+
+auto write(FILE *f, const NoteEvent &e) -> void
+{
+  fprintf(f,
+          "%.3f %d %s %s %.2f\n",
+          e.time,
+          e.lane,
+          e.isOn ? "on" : "off",
+          noteName(e.key).c_str(),
+          e.confidence / 255.f);
+}
+
+PitchTracker::PitchTracker(const std::vector<float> &freqs, float frameRate)
+  : firstKey(std::max(static_cast<int>(ceilf(toSemitone(config().startFreq) - 1e-3f)), 0)),
+    lastKey(std::min(static_cast<int>(floorf(toSemitone(config().endFreq) + 1e-3f)), PianoKeys - 1)),
+    hits(PianoKeys),
+    misses(PianoKeys),
+    confidence(PianoKeys)
+{
+  if (frameRate <= 0)
+    frameRate = 1.f * config().sampleFreq / config().hopSize;
+  onFrames = std::max(static_cast<int>(lroundf(OnTime * frameRate)), 1);
+  offFrames = std::max(static_cast<int>(lroundf(OffTime * frameRate)), 1);
+  changed.reserve(PianoKeys);
+  detected.resize(PianoKeys);
+  for (auto h = 1; h <= Harmonics; ++h)
+    offsets.push_back(static_cast<int>(lroundf(12.f * log2f(h))));
+  if (lastKey < firstKey)
+    return;
+  // Klapuri's weights, the higher harmonics of the low notes count less
+  for (auto key = firstKey; key <= lastKey; ++key)
+  {
+    const auto f0 = 55.f * powf(2.f, key / 12.f);
+    for (auto h = 1; h <= Harmonics; ++h)
+      weights.push_back((f0 + 27.f) / (h * f0 + 320.f));
+  }
+  bands.resize(lastKey - firstKey + 1 + offsets.back());
+  sorted.resize(bands.size());
+  const auto lowest = 55.f * powf(2.f, (firstKey - .5f) / 12.f);
+  firstBin = std::lower_bound(std::begin(freqs), std::end(freqs), lowest) - std::begin(freqs);
+  firstBin = std::max(firstBin, 1);
+  for (auto i = firstBin; i + 1 < static_cast<int>(freqs.size()); ++i)
+  {
+    const auto band = static_cast<int>(floorf(toSemitone(freqs[i]) + .5f)) - firstKey;
+    if (band >= static_cast<int>(bands.size()))
+      break;
+    bandOf.push_back(std::max(band, 0));
+  }
+}
+
+auto PitchTracker::salience(int k) const -> float
+{
+  const auto *w = weights.data() + k * Harmonics;
+  auto res = 0.f;
+  for (auto h = 0; h < Harmonics; ++h)
+    res += w[h] * bands[k + offsets[h]];
+  return res;
+}
+
+auto PitchTracker::apply(const float *spectr, const float *gains) -> void
+{
+  changed.clear();
+  std::fill(std::begin(detected), std::end(detected), 0.f);
+  if (!bands.empty())
+  {
+    std::fill(std::begin(bands), std::end(bands), 0.f);
+    // only the spectral peaks count, the skirts of a strong partial would light up the neighbor keys;
+    // the loudness weighting is undone, it tilts the partials and the octave below would win
+    for (auto i = 0; i < static_cast<int>(bandOf.size()); ++i)
+    {
+      const auto *p = spectr + firstBin + i;
+      if (p[0] > p[-1] && p[0] >= p[1])
+        bands[bandOf[i]] = std::max(bands[bandOf[i]], p[0] / gains[firstBin + i]);
+    }
+    // the median band is the noise floor, the notes are few compared to the bands
+    std::copy(std::begin(bands), std::end(bands), std::begin(sorted));
+    const auto mid = std::begin(sorted) + sorted.size() / 2;
+    std::nth_element(std::begin(sorted), mid, std::end(sorted));
+    const auto noise = std::max(*mid, MinLevel / 2);
+
+    auto strongest = 0.f;
+    for (auto n = 0; n < MaxPolyphony; ++n)
+    {
+      auto best = -1;
+      auto bestSalience = 0.f;
+      for (auto k = 0; k <= lastKey - firstKey; ++k)
+      {
+        // the fundamental has to be there, otherwise the octave below a note scores on its harmonics
+        if (bands[k] < 2 * noise || detected[firstKey + k] > 0)
+          continue;
+        if (const auto s = salience(k); s > bestSalience)
+        {
+          best = k;
+          bestSalience = s;
+        }
+      }
+      if (best < 0 || bestSalience < MinShare * strongest)
+        break;
+      auto noiseSalience = 0.f;
+      for (auto h = 0; h < Harmonics; ++h)
+        noiseSalience += weights[best * Harmonics + h] * noise;
+      const auto c = 1.f - noiseSalience / bestSalience;
+      if (c < MinConfidence)
+        break;
+      detected[firstKey + best] = c;
+      strongest = std::max(strongest, bestSalience);
+      // the partials of a note are expected to have a smooth envelope, whatever sticks out of it
+      // belongs to other notes and stays
+      float levels[Harmonics];
+      for (auto h = 0; h < Harmonics; ++h)
+        levels[h] = bands[best + offsets[h]];
+      bands[best] = 0;
+      for (auto h = 1; h < Harmonics; ++h)
+      {
+        const auto smooth = h + 1 < Harmonics ? (levels[h - 1] + levels[h + 1]) / 2 : levels[h - 1];
+        bands[best + offsets[h]] -= std::min(levels[h], smooth);
+      }
+    }
+  }
+
+  for (auto key = 0; key < PianoKeys; ++key)
+  {
+    if (detected[key] > 0)
+    {
+      ++hits[key];
+      misses[key] = 0;
+    }
+    else
+    {
+      hits[key] = 0;
+      ++misses[key];
+    }
+    if (confidence[key] == 0)
+    {
+      if (hits[key] >= onFrames)
+      {
+        confidence[key] = detected[key];
+        changed.push_back(key);
+      }
+    }
+    else if (detected[key] > 0)
+      confidence[key] += 0.5f * (detected[key] - confidence[key]);
+    else if (misses[key] >= offFrames)
+    {
+      confidence[key] = 0;
+      changed.push_back(key);
+    }
+  }
+}
+
+auto PitchTracker::reset() -> void
+{
+  changed.clear();
+  for (auto key = 0; key < PianoKeys; ++key)
+  {
+    hits[key] = 0;
+    misses[key] = 0;
+    if (confidence[key] > 0)
+    {
+      confidence[key] = 0;
+      changed.push_back(key);
+    }
+  }
+}
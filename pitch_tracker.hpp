@@ -0,0 +1,65 @@
+#pragma once
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// a note starting or stopping, packed for the event stream
+struct NoteEvent
+{
+  // seconds of audio analyzed before the frame the change was detected in
+  float time;
+  uint8_t lane;
+  // piano key, 0 is A1 at 55 Hz like the keyboards of the display
+  uint8_t key;
+  // 0..255, 0 for a note off
+  uint8_t confidence;
+  bool isOn;
+};
+
+// scientific name of a piano key, A1 for 0
+auto noteName(int key) -> std::string;
+// one line per event: time, lane, on or off, note and confidence, e.g. "1.344 0 on A3 0.97"
+auto write(FILE *, const NoteEvent &) -> void;
+
+// Polyphonic pitch estimation over the keys of the displayed frequency range. Every frame the
+// spectrum is reduced to one level per semitone, the keys are scored by the weighted sum of the
+// levels at their harmonics, and the best key is taken and its harmonics are cancelled until no
+// key stands out of the noise floor. A key turns on after it was found in a few consecutive
+// frames and off after it was missed for a few, so one instance should see one stream of frames.
+class PitchTracker
+{
+public:
+  // frameRate is the number of frames per second apply() gets, 0 for the hop rate of the config
+  PitchTracker(const std::vector<float> &freqs = {}, float frameRate = 0);
+  // spectr is weighted by gains, see ElcTable
+  auto apply(const float *spectr, const float *gains) -> void;
+  // turns all the notes off, they show up in changes()
+  auto reset() -> void;
+  // PianoKeys confidences 0..1 of the sounding notes, 0 for the silent keys
+  auto notes() const -> const std::vector<float> & { return confidence; }
+  // keys which turned on or off in the last apply(), see notes() for which
+  auto changes() const -> const std::vector<int> & { return changed; }
+
+private:
+  auto salience(int key) const -> float;
+
+  int firstKey;
+  int lastKey;
+  // the spectrum range reduced to the semitone bands and the band of every bin in it
+  int firstBin = 0;
+  std::vector<int16_t> bandOf;
+  std::vector<float> bands;
+  std::vector<float> sorted;
+  // band offsets and weights of the harmonics, the weights per key
+  std::vector<int> offsets;
+  std::vector<float> weights;
+  std::vector<float> detected;
+  // consecutive frames a key was found or missed, decides the on and off
+  std::vector<int> hits;
+  std::vector<int> misses;
+  int onFrames;
+  int offFrames;
+  std::vector<float> confidence;
+  std::vector<int> changed;
+};
@@ -0,0 +1,103 @@
+#include "png_writer.hpp"
+#include <algorithm>
+#include <log/log.hpp>
+
+static auto be32(uint8_t *p, uint32_t v) -> void
+{
+  p[0] = v >> 24;
+  p[1] = v >> 16;
+  p[2] = v >> 8;
+  p[3] = v;
+}
+
+PngWriter::PngWriter(const std::string &path, int width, int height, int channels)
+  : f(fopen(path.c_str(), "wb")), width(width), height(height), channels(channels), buf(1 << 16)
+{
+  if (!f)
+  {
+    LOG("Could not create", path);
+    throw -15;
+  }
+  const uint8_t signature[] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+  fwrite(signature, 1, sizeof(signature), f);
+  uint8_t ihdr[13];
+  be32(ihdr, width);
+  be32(ihdr + 4, height);
+  ihdr[8] = 8; // bit depth
+  ihdr[9] = channels == 1 ? 0 : channels == 3 ? 2 : 6;
+  ihdr[10] = 0; // deflate
+  ihdr[11] = 0; // adaptive filtering
+  ihdr[12] = 0; // no interlace
+  writeChunk("IHDR", ihdr, sizeof(ihdr));
+
+  zs = {};
+  deflateInit(&zs, Z_DEFAULT_COMPRESSION);
+}
+
+PngWriter::~PngWriter()
+{
+  std::vector<uint8_t> empty(width * channels);
+  while (rows < height - 1)
+    addRow(empty.data());
+  if (rows < height)
+  {
+    ++rows;
+    deflateRow(empty.data(), Z_FINISH);
+  }
+  else
+    deflateRow(nullptr, Z_FINISH);
+  deflateEnd(&zs);
+  writeChunk("IEND", nullptr, 0);
+  fclose(f);
+}
+
+auto PngWriter::addRow(const uint8_t *row) -> void
+{
+  if (rows >= height)
+    return;
+  ++rows;
+  deflateRow(row, Z_NO_FLUSH);
+}
+
+auto PngWriter::deflateRow(const uint8_t *row, int flush) -> void
+{
+  // every row starts with the filter type, 0 is none
+  uint8_t filter = 0;
+  const auto feed = [this](const uint8_t *data, std::size_t size, int flush) {
+    zs.next_in = const_cast<uint8_t *>(data);
+    zs.avail_in = size;
+    for (;;)
+    {
+      zs.next_out = buf.data();
+      zs.avail_out = buf.size();
+      const auto ret = deflate(&zs, flush);
+      if (zs.avail_out < buf.size())
+        writeChunk("IDAT", buf.data(), buf.size() - zs.avail_out);
+      if (flush == Z_FINISH ? ret == Z_STREAM_END : zs.avail_in == 0 && zs.avail_out > 0)
+        break;
+    }
+  };
+  if (row)
+  {
+    feed(&filter, 1, Z_NO_FLUSH);
+    feed(row, width * channels, flush);
+  }
+  else
+    feed(nullptr, 0, flush);
+}
+
+auto PngWriter::writeChunk(const char *type, const uint8_t *data, std::size_t size) -> void
+{
+  uint8_t header[8];
+  be32(header, size);
+  std::copy(type, type + 4, header + 4);
+  fwrite(header, 1, sizeof(header), f);
+  if (size > 0)
+    fwrite(data, 1, size, f);
+  auto crc = crc32(0, header + 4, 4);
+  if (size > 0)
+    crc = crc32(crc, data, size);
+  uint8_t crcBytes[4];
+  be32(crcBytes, crc);
+  fwrite(crcBytes, 1, sizeof(crcBytes), f);
+}
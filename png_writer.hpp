@@ -0,0 +1,33 @@
+#pragma once
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <zlib.h>
+
+// Streaming 8-bit PNG writer, rows are compressed and written as they come so the image never has
+// to be kept in memory.
+class PngWriter
+{
+public:
+  // channels: 1 - gray, 3 - RGB, 4 - RGBA
+  PngWriter(const std::string &path, int width, int height, int channels);
+  // missing rows are filled with zeros
+  ~PngWriter();
+  PngWriter(const PngWriter &) = delete;
+  PngWriter &operator=(const PngWriter &) = delete;
+  // width * channels bytes
+  auto addRow(const uint8_t *row) -> void;
+
+private:
+  auto writeChunk(const char *type, const uint8_t *data, std::size_t size) -> void;
+  auto deflateRow(const uint8_t *row, int flush) -> void;
+
+  FILE *f;
+  int width;
+  int height;
+  int channels;
+  int rows = 0;
+  z_stream zs;
+  std::vector<uint8_t> buf;
+};
@@ -0,0 +1,185 @@
+#include "profiler.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <log/log.hpp>
+#include <vector>
+
+namespace
+{
+  // the rings of the calling thread, handed back to the profiler when the thread exits
+  struct Binding
+  {
+    void *rings = nullptr;
+    std::atomic<bool> *isUsed = nullptr;
+    // all the rings are taken, the samples of the thread are dropped
+    bool isRejected = false;
+    ~Binding()
+    {
+      if (isUsed)
+        isUsed->store(false, std::memory_order_release);
+    }
+  };
+  thread_local Binding binding;
+} // namespace
+
+auto Profiler::instance() -> Profiler &
+{
+  static Profiler profiler;
+  return profiler;
+}
+
+auto Profiler::setEnabled(bool value) -> void
+{
+  enabled = value;
+}
+
+auto Profiler::add(const char *name, float us) -> void
+{
+  const auto idx = sectionIdx(name);
+  auto *rings = threadRings();
+  if (idx < 0 || !rings)
+    return;
+  auto &ring = rings->sections[idx];
+  const auto count = ring.count.load(std::memory_order_relaxed);
+  ring.samples[count % History].store(us, std::memory_order_relaxed);
+  ring.count.store(count + 1, std::memory_order_release);
+}
+
+auto Profiler::reserve(const char *name) -> void
+{
+  sectionIdx(name);
+  threadRings();
+}
+
+auto Profiler::sectionIdx(const char *name) -> int
+{
+  // the literals of a section are usually one and the same
+  const auto num = sectionsNum.load(std::memory_order_acquire);
+  for (auto i = 0; i < num; ++i)
+    if (names[i].load(std::memory_order_relaxed) == name)
+      return i;
+  for (auto i = 0; i < num; ++i)
+    if (strcmp(names[i].load(std::memory_order_relaxed), name) == 0)
+      return i;
+  std::lock_guard<std::mutex> lock(mutex);
+  const auto newNum = sectionsNum.load(std::memory_order_relaxed);
+  for (auto i = num; i < newNum; ++i)
+    if (strcmp(names[i].load(std::memory_order_relaxed), name) == 0)
+      return i;
+  if (newNum == MaxSections)
+    return -1;
+  names[newNum].store(name, std::memory_order_relaxed);
+  sectionsNum.store(newNum + 1, std::memory_order_release);
+  return newNum;
+}
+
+auto Profiler::threadRings() -> Rings *
+{
+  if (binding.rings || binding.isRejected)
+    return static_cast<Rings *>(binding.rings);
+  std::lock_guard<std::mutex> lock(mutex);
+  Rings *res = nullptr;
+  const auto num = threadsNum.load(std::memory_order_relaxed);
+  for (auto i = 0; i < num && !res; ++i)
+  {
+    auto isUsed = false;
+    if (threads[i]->isUsed.compare_exchange_strong(isUsed, true, std::memory_order_acquire))
+      res = threads[i];
+  }
+  if (!res)
+  {
+    if (num == MaxThreads)
+    {
+      LOG("Too many threads to profile, dropping the samples of one more");
+      binding.isRejected = true;
+      return nullptr;
+    }
+    res = new Rings();
+    threads[num] = res;
+    threadsNum.store(num + 1, std::memory_order_release);
+  }
+  binding.rings = res;
+  binding.isUsed = &res->isUsed;
+  return res;
+}
+
+auto Profiler::stats(int section) const -> Stats
+{
+  // a sample may be overwritten by a newer one while it is copied, which is as good for the
+  // statistics
+  Stats res{};
+  std::vector<float> samples;
+  const auto num = threadsNum.load(std::memory_order_acquire);
+  for (auto i = 0; i < num; ++i)
+  {
+    const auto &ring = threads[i]->sections[section];
+    const auto count = ring.count.load(std::memory_order_acquire);
+    res.count += count;
+    for (auto j = 0; j < std::min<long long>(count, History); ++j)
+      samples.push_back(ring.samples[j].load(std::memory_order_relaxed));
+  }
+  if (samples.empty())
+    return res;
+  for (const auto s : samples)
+    res.mean += s;
+  res.mean /= samples.size();
+  const auto percentile = [&samples](float p) {
+    const auto nth = std::begin(samples) + static_cast<int>(p * (samples.size() - 1));
+    std::nth_element(std::begin(samples), nth, std::end(samples));
+    return *nth;
+  };
+  res.p50 = percentile(.5f);
+  res.p99 = percentile(.99f);
+  res.max = *std::max_element(std::begin(samples), std::end(samples));
+  return res;
+}
+
+auto Profiler::report() const -> std::string
+{
+  std::string res;
+  const auto num = sectionsNum.load(std::memory_order_acquire);
+  for (auto i = 0; i < num; ++i)
+  {
+    const auto s = stats(i);
+    char line[256];
+    snprintf(line,
+             sizeof(line),
+             "%-20s p50 %8.1f us  p99 %8.1f us  max %8.1f us  n %lld\n",
+             names[i].load(std::memory_order_relaxed),
+             s.p50,
+             s.p99,
+             s.max,
+             s.count);
+    res += line;
+  }
+  return res;
+}
+
+auto Profiler::dump(const std::string &path) const -> void
+{
+  auto f = fopen(path.c_str(), "w");
+  if (!f)
+  {
+    LOG("Could not create", path);
+    return;
+  }
+  fprintf(f, "{\n  \"history\": %d,\n  \"sections\": [", History);
+  const auto num = sectionsNum.load(std::memory_order_acquire);
+  for (auto i = 0; i < num; ++i)
+  {
+    const auto s = stats(i);
+    fprintf(f,
+            "%s\n    {\"name\": \"%s\", \"count\": %lld, \"mean_us\": %g, \"p50_us\": %g, \"p99_us\": %g, "
+            "\"max_us\": %g}",
+            i == 0 ? "" : ",",
+            names[i].load(std::memory_order_relaxed),
+            s.count,
+            s.mean,
+            s.p50,
+            s.p99,
+            s.max);
+  }
+  fprintf(f, "\n  ]\n}\n");
+  fclose(f);
+}
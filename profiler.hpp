@@ -0,0 +1,87 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+
+// Rolling timing statistics of named code sections, fed by the render and the analysis threads.
+// Disabled by default, so the batch modes pay only for an atomic load per timer. Every thread
+// writes its samples to rings of its own, report() and dump() read all of them without a lock.
+class Profiler
+{
+public:
+  static auto instance() -> Profiler &;
+  auto setEnabled(bool) -> void;
+  auto isEnabled() const -> bool { return enabled.load(std::memory_order_relaxed); }
+  // name has to be a string literal
+  auto add(const char *name, float us) -> void;
+  // registers the section of name and the rings of the calling thread without a sample, so a thread
+  // which reports its first sample late does not allocate in the steady state
+  auto reserve(const char *name) -> void;
+  // one line per section with the percentiles of the last samples
+  auto report() const -> std::string;
+  // the same as JSON
+  auto dump(const std::string &path) const -> void;
+
+private:
+  static const auto History = 512;
+  static const auto MaxSections = 32;
+  static const auto MaxThreads = 64;
+  // the last samples of a section on one thread, written by that thread only
+  struct Ring
+  {
+    std::atomic<float> samples[History];
+    std::atomic<long long> count{0};
+  };
+  struct Rings
+  {
+    Ring sections[MaxSections];
+    // taken by a running thread, a thread which exits leaves its rings to the next one
+    std::atomic<bool> isUsed{true};
+  };
+  struct Stats
+  {
+    float mean;
+    float p50;
+    float p99;
+    float max;
+    long long count;
+  };
+  auto stats(int section) const -> Stats;
+  // the index of the section of name, registered on first use; -1 once all the sections are taken
+  auto sectionIdx(const char *name) -> int;
+  // the rings of the calling thread, taken on first use; nullptr once all the rings are taken
+  auto threadRings() -> Rings *;
+
+  std::atomic<bool> enabled{false};
+  // taken only to register a section or the rings of a thread
+  std::mutex mutex;
+  std::atomic<const char *> names[MaxSections];
+  std::atomic<int> sectionsNum{0};
+  // never freed, a thread may still exit after the end of main
+  Rings *threads[MaxThreads] = {};
+  std::atomic<int> threadsNum{0};
+};
+
+// adds the lifetime of the object to the section
+class ScopedTimer
+{
+public:
+  ScopedTimer(const char *name)
+    : name(Profiler::instance().isEnabled() ? name : nullptr),
+      start(this->name ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point{})
+  {
+  }
+  ~ScopedTimer()
+  {
+    if (name)
+      Profiler::instance().add(
+        name, std::chrono::duration<float, std::micro>(std::chrono::steady_clock::now() - start).count());
+  }
+  ScopedTimer(const ScopedTimer &) = delete;
+  ScopedTimer &operator=(const ScopedTimer &) = delete;
+
+private:
+  const char *name;
+  std::chrono::steady_clock::time_point start;
+};
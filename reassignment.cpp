@@ -0,0 +1,82 @@
+#include "reassignment.hpp"
+#include "cqt.hpp"
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+  // the Hann window is 1 - cos, twice the usual one: the rectangular window is scaled to the
+  // exponential window level and the peaks keep it; plain floats, std::complex does not inline as
+  // well in the hot loop
+  auto hann(const fftwf_complex *bins, int k, float &re, float &im) -> void
+  {
+    re = bins[k][0] - 0.5f * (bins[k - 1][0] + bins[k + 1][0]);
+    im = bins[k][1] - 0.5f * (bins[k - 1][1] + bins[k + 1][1]);
+  }
+
+  auto power(const fftwf_complex *bins, int k) -> float
+  {
+    float re, im;
+    hann(bins, k, re, im);
+    return re * re + im * im;
+  }
+} // namespace
+
+auto Reassignment::binFreqs(ReassignmentParams p) -> std::vector<float>
+{
+  return Cqt::binFreqs({p.minFreq, p.maxFreq, p.binsPerSemitone, p.fftSize, p.sampleFreq});
+}
+
+Reassignment::Reassignment(ReassignmentParams p)
+  : p(p),
+    binsNum(static_cast<int>(binFreqs(p).size())),
+    firstBin(std::max(static_cast<int>(floorf(p.minFreq * p.fftSize / p.sampleFreq)) - 1, 2)),
+    lastBin(std::min(static_cast<int>(ceilf(p.maxFreq * p.fftSize / p.sampleFreq)) + 1, p.fftSize / 2 - 2))
+{
+}
+
+auto Reassignment::partial(const fftwf_complex *bins, int k) const -> Partial
+{
+  float re, im;
+  hann(bins, k, re, im);
+  // the derivative of the window is sin, -j pi / n (X[k - 1] - X[k + 1]) scaled the same way; the
+  // instantaneous frequency is k - n / (2 pi) Im(Xd conj(Xh)) / |Xh|^2 bins, which comes down to
+  // k + Re((X[k - 1] - X[k + 1]) conj(Xh)) / (2 |Xh|^2)
+  const auto norm = re * re + im * im;
+  const auto dot = (bins[k - 1][0] - bins[k + 1][0]) * re + (bins[k - 1][1] - bins[k + 1][1]) * im;
+  const auto offset = norm > 0 ? std::clamp(0.5f * dot / norm, -1.f, 1.f) : 0.f;
+  // the main lobe of the Hann window is sinc(x) / (1 - x^2) and the peak bin is off by up to half a
+  // bin; the inverse fitted over that range is within 1e-4
+  const auto x2 = std::min(offset * offset, 0.25f);
+  const auto scallop = 1 + x2 * (0.6431f + 0.2756f * x2);
+  return {(k + offset) * p.sampleFreq / p.fftSize, std::sqrt(norm) * scallop};
+}
+
+auto Reassignment::isPeak(const fftwf_complex *bins, int k) -> bool
+{
+  const auto cur = power(bins, k);
+  return cur > power(bins, k - 1) && cur >= power(bins, k + 1);
+}
+
+auto Reassignment::apply(const fftwf_complex *bins, const float *gain, float *out) const -> void
+{
+  std::fill(out, out + binsNum, 0.f);
+  const auto binsPerOctave = 12.f * p.binsPerSemitone;
+  auto prev = power(bins, firstBin - 1);
+  auto cur = power(bins, firstBin);
+  for (auto k = firstBin; k <= lastBin; ++k)
+  {
+    const auto next = power(bins, k + 1);
+    if (cur > prev && cur >= next)
+    {
+      const auto partial = this->partial(bins, k);
+      // rounds, the position is only negative below the grid
+      const auto pos = log2f(partial.freq / p.minFreq) * binsPerOctave + 0.5f;
+      const auto j = static_cast<int>(pos);
+      if (pos >= 0 && j < binsNum)
+        out[j] = std::max(out[j], gain[j] * partial.level);
+    }
+    prev = cur;
+    cur = next;
+  }
+}
@@ -0,0 +1,47 @@
+#pragma once
+#include <fftw3.h>
+#include <vector>
+
+struct ReassignmentParams
+{
+  float minFreq;
+  float maxFreq;
+  int binsPerSemitone;
+  int fftSize;
+  int sampleFreq;
+};
+
+// a sinusoid found in a frame, the level is in the units of the linear spectrum
+struct Partial
+{
+  float freq;
+  float level;
+};
+
+// Time-frequency reassignment of the FFT peaks. The Hann window and its derivative are both
+// three tap kernels on the bins of the rectangular window, so one FFT gives the instantaneous
+// frequency of every peak with no bias for a steady sinusoid. The peaks are drawn as lines on a
+// fine logarithmic grid, a 4096 point frame places a partial at least as precisely as the bins
+// of a 32768 point one, see the --accuracy mode.
+class Reassignment
+{
+public:
+  Reassignment(ReassignmentParams);
+  // the same logarithmic grid as the constant-Q bins
+  static auto binFreqs(ReassignmentParams) -> std::vector<float>;
+  auto size() const -> int { return binsNum; }
+  // the partial whose Hann main lobe peaks at FFT bin k; bins are the fftSize / 2 + 1 bins of a
+  // real FFT of the frame with the rectangular window
+  auto partial(const fftwf_complex *bins, int k) const -> Partial;
+  // whether the Hann magnitude peaks at FFT bin k, apply() draws the partials of these bins
+  static auto isPeak(const fftwf_complex *bins, int k) -> bool;
+  // out[k] = gain[k] * level of the strongest partial which falls into bin k, 0 between them
+  auto apply(const fftwf_complex *bins, const float *gain, float *out) const -> void;
+
+private:
+  ReassignmentParams p;
+  int binsNum;
+  // FFT bins searched for the peaks
+  int firstBin;
+  int lastBin;
+};
@@ -0,0 +1,358 @@
+#include "recording.hpp"
+#include "config.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <log/log.hpp>
+#include <thread>
+#include <zlib.h>
+
+static const auto ChunkFrames = 64;
+static const auto ChunksNum = 8;
+static const auto MinDb = 0.f;
+static const auto MaxDb = 160.f;
+
+template <typename T>
+static auto put(FILE *f, T v) -> void
+{
+  fwrite(&v, sizeof(v), 1, f);
+}
+
+template <typename T>
+static auto get(FILE *f) -> T
+{
+  T v{};
+  if (fread(&v, sizeof(v), 1, f) != 1)
+    throw -20;
+  return v;
+}
+
+namespace
+{
+  // recorders whose file is not closed yet
+  std::mutex openMutex;
+  std::condition_variable closedCv;
+  int openNum = 0;
+} // namespace
+
+Recorder::Recorder(const std::string &path, const std::vector<float> &freqs, int bits) : io(std::make_shared<Io>())
+{
+  io->f = fopen(path.c_str(), "wb");
+  if (!io->f)
+  {
+    LOG("Could not create", path);
+    throw -17;
+  }
+  auto f = io->f;
+  from = std::lower_bound(std::begin(freqs), std::end(freqs), config().startFreq) - std::begin(freqs);
+  bins = std::lower_bound(std::begin(freqs), std::end(freqs), config().endFreq) - std::begin(freqs) - from;
+  fwrite("SPGR", 1, 4, f);
+  put<uint32_t>(f, 1);
+  put<uint32_t>(f, bits);
+  put<uint32_t>(f, bins);
+  put<float>(f, MinDb);
+  put<float>(f, MaxDb);
+  put<uint64_t>(f,
+                std::chrono::duration_cast<std::chrono::milliseconds>(
+                  std::chrono::system_clock::now().time_since_epoch())
+                  .count());
+  fwrite(freqs.data() + from, sizeof(float), bins, f);
+
+  io->bits = bits;
+  io->bins = bins;
+  io->chunks.resize(ChunksNum);
+  for (auto i = 0; i < ChunksNum; ++i)
+  {
+    io->chunks[i].times.reserve(ChunkFrames);
+    io->chunks[i].mags.reserve(ChunkFrames * bins);
+    io->freeChunks.push_back(i);
+  }
+  {
+    std::lock_guard<std::mutex> lock(openMutex);
+    ++openNum;
+  }
+  std::thread([io = io]() {
+    io->run();
+    io->close();
+    std::lock_guard<std::mutex> lock(openMutex);
+    --openNum;
+    closedCv.notify_all();
+  }).detach();
+}
+
+Recorder::~Recorder()
+{
+  // the last owner may be the analysis or the render thread, neither of them waits for the disk
+  {
+    std::lock_guard<std::mutex> lock(io->mutex);
+    if (io->current >= 0 && !io->chunks[io->current].times.empty())
+      io->fullChunks.push_back(io->current);
+    io->done = true;
+  }
+  io->cv.notify_one();
+}
+
+auto Recorder::waitClosed() -> void
+{
+  std::unique_lock<std::mutex> lock(openMutex);
+  closedCv.wait(lock, []() { return openNum == 0; });
+}
+
+auto Recorder::push(const float *spectr, double time) -> void
+{
+  std::lock_guard<std::mutex> lock(io->mutex);
+  if (firstTime < 0)
+    firstTime = time;
+  if (io->current < 0)
+  {
+    if (io->freeChunks.empty())
+    {
+      ++io->droppedNum;
+      return;
+    }
+    io->current = io->freeChunks.back();
+    io->freeChunks.pop_back();
+  }
+  auto &c = io->chunks[io->current];
+  c.times.push_back(time - firstTime);
+  c.mags.insert(std::end(c.mags), spectr + from, spectr + from + bins);
+  if (c.times.size() == ChunkFrames)
+  {
+    io->fullChunks.push_back(io->current);
+    io->current = -1;
+    io->cv.notify_one();
+  }
+}
+
+auto Recorder::Io::run() -> void
+{
+  for (;;)
+  {
+    int idx;
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      cv.wait(lock, [this]() { return done || !fullChunks.empty(); });
+      if (fullChunks.empty())
+        return;
+      idx = fullChunks.front();
+      fullChunks.erase(std::begin(fullChunks));
+    }
+    write(chunks[idx]);
+    std::lock_guard<std::mutex> lock(mutex);
+    chunks[idx].times.clear();
+    chunks[idx].mags.clear();
+    freeChunks.push_back(idx);
+  }
+}
+
+auto Recorder::Io::close() -> void
+{
+  const auto indexOffset = static_cast<uint64_t>(ftell(f));
+  for (const auto &e : index)
+  {
+    put(f, e.firstTime);
+    put(f, e.lastTime);
+    put(f, e.offset);
+    put(f, e.frames);
+  }
+  put<uint64_t>(f, indexOffset);
+  put<uint32_t>(f, index.size());
+  fwrite("SPGI", 1, 4, f);
+  fclose(f);
+  if (droppedNum > 0)
+    LOG("Recording dropped", droppedNum, "frames");
+}
+
+auto Recorder::Io::write(const Chunk &c) -> void
+{
+  const auto frames = static_cast<int>(c.times.size());
+  const auto bytes = bits / 8;
+  const auto maxQ = (1 << bits) - 1;
+  quantized.resize(frames * sizeof(double) + frames * bins * bytes);
+  memcpy(quantized.data(), c.times.data(), frames * sizeof(double));
+  auto p = quantized.data() + frames * sizeof(double);
+  for (auto j = 0; j < frames; ++j)
+    for (auto i = 0; i < bins; ++i)
+    {
+      const auto quantize = [maxQ](float mag) {
+        const auto db = 20.f * log10f(std::max(mag, 1e-10f));
+        return static_cast<int>(std::clamp((db - MinDb) / (MaxDb - MinDb), 0.f, 1.f) * maxQ + .5f);
+      };
+      const auto q = quantize(c.mags[j * bins + i]);
+      const auto prev = j > 0 ? quantize(c.mags[(j - 1) * bins + i]) : 0;
+      const auto d = (q - prev) & maxQ;
+      *p++ = d & 0xff;
+      if (bytes == 2)
+        *p++ = d >> 8;
+    }
+
+  auto size = compressBound(quantized.size());
+  compressed.resize(size);
+  compress2(compressed.data(), &size, quantized.data(), quantized.size(), 1);
+
+  index.push_back({c.times.front(), c.times.back(), static_cast<uint64_t>(ftell(f)), static_cast<uint32_t>(frames)});
+  put<uint32_t>(f, frames);
+  put<uint32_t>(f, size);
+  fwrite(compressed.data(), 1, size, f);
+}
+
+RecordingReader::RecordingReader(const std::string &path) : f(fopen(path.c_str(), "rb"))
+{
+  if (!f)
+  {
+    LOG("Could not open", path);
+    throw -18;
+  }
+  char magic[4];
+  if (fread(magic, 1, 4, f) != 4 || memcmp(magic, "SPGR", 4) != 0 || get<uint32_t>(f) != 1)
+  {
+    LOG("Not a spectrogram recording", path);
+    throw -19;
+  }
+  bits = get<uint32_t>(f);
+  binFreqs.resize(get<uint32_t>(f));
+  minDb = get<float>(f);
+  maxDb = get<float>(f);
+  start = get<uint64_t>(f);
+  if (fread(binFreqs.data(), sizeof(float), binFreqs.size(), f) != binFreqs.size())
+    throw -20;
+  const auto chunksStart = ftell(f);
+  q.resize(binFreqs.size());
+  scratch.resize(binFreqs.size());
+
+  // the index is at the end of the file
+  fseek(f, 0, SEEK_END);
+  const auto fileSize = ftell(f);
+  auto indexOffset = uint64_t{0};
+  auto chunksNum = uint32_t{0};
+  auto isIndexed = false;
+  if (fileSize >= chunksStart + 16)
+  {
+    fseek(f, -16, SEEK_END);
+    indexOffset = get<uint64_t>(f);
+    chunksNum = get<uint32_t>(f);
+    isIndexed = fread(magic, 1, 4, f) == 4 && memcmp(magic, "SPGI", 4) == 0;
+  }
+  if (isIndexed)
+  {
+    fseek(f, indexOffset, SEEK_SET);
+    for (auto i = 0U; i < chunksNum; ++i)
+    {
+      RecordingIndexEntry e;
+      e.firstTime = get<double>(f);
+      e.lastTime = get<double>(f);
+      e.offset = get<uint64_t>(f);
+      e.frames = get<uint32_t>(f);
+      index.push_back(e);
+    }
+  }
+  else
+  {
+    LOG("Recording without index, scanning", path);
+    scan(chunksStart);
+  }
+  if (!index.empty())
+    load(0);
+}
+
+RecordingReader::~RecordingReader()
+{
+  fclose(f);
+}
+
+auto RecordingReader::scan(long from) -> void
+{
+  fseek(f, from, SEEK_SET);
+  for (;;)
+  {
+    const auto offset = ftell(f);
+    uint32_t header[2];
+    if (fread(header, sizeof(header[0]), 2, f) != 2 || fseek(f, header[1], SEEK_CUR) != 0)
+      break;
+    try
+    {
+      index.push_back({0, 0, static_cast<uint64_t>(offset), header[0]});
+      load(index.size() - 1);
+      index.back().firstTime = times.front();
+      index.back().lastTime = times.back();
+      fseek(f, offset + 8 + header[1], SEEK_SET);
+    }
+    catch (int)
+    {
+      // truncated last chunk
+      index.pop_back();
+      break;
+    }
+  }
+}
+
+auto RecordingReader::duration() const -> double
+{
+  return index.empty() ? 0 : index.back().lastTime;
+}
+
+auto RecordingReader::load(int value) -> void
+{
+  const auto &e = index[value];
+  fseek(f, e.offset, SEEK_SET);
+  const auto frames = get<uint32_t>(f);
+  const auto size = get<uint32_t>(f);
+  compressed.resize(size);
+  if (fread(compressed.data(), 1, size, f) != size)
+    throw -20;
+  auto payloadSize = static_cast<uLongf>(frames * sizeof(double) + frames * binFreqs.size() * bits / 8);
+  payload.resize(payloadSize);
+  if (uncompress(payload.data(), &payloadSize, compressed.data(), size) != Z_OK)
+    throw -21;
+  times.resize(frames);
+  memcpy(times.data(), payload.data(), frames * sizeof(double));
+  std::fill(std::begin(q), std::end(q), 0);
+  chunk = value;
+  frame = 0;
+}
+
+auto RecordingReader::decode(float *mags) -> void
+{
+  const auto bytes = bits / 8;
+  const auto maxQ = (1 << bits) - 1;
+  const auto bins = static_cast<int>(binFreqs.size());
+  auto p = payload.data() + times.size() * sizeof(double) + frame * bins * bytes;
+  for (auto i = 0; i < bins; ++i, p += bytes)
+  {
+    const auto d = bytes == 2 ? p[0] | (p[1] << 8) : p[0];
+    q[i] = (q[i] + d) & maxQ;
+    mags[i] = powf(10.f, (minDb + 1.f * q[i] / maxQ * (maxDb - minDb)) / 20.f);
+  }
+  ++frame;
+}
+
+auto RecordingReader::seek(double time) -> void
+{
+  if (index.empty())
+    return;
+  auto it = std::upper_bound(std::begin(index), std::end(index), time, [](double t, const auto &e) {
+    return t < e.firstTime;
+  });
+  load(std::max(0, static_cast<int>(it - std::begin(index)) - 1));
+  // only the frames of this chunk before the time are decoded
+  while (frame < static_cast<int>(times.size()) && times[frame] < time)
+    decode(scratch.data());
+  if (frame == static_cast<int>(times.size()) && chunk + 1 < static_cast<int>(index.size()))
+    load(chunk + 1);
+}
+
+auto RecordingReader::next(float *mags, double &time) -> bool
+{
+  if (chunk < 0)
+    return false;
+  if (frame == static_cast<int>(times.size()))
+  {
+    if (chunk + 1 >= static_cast<int>(index.size()))
+      return false;
+    load(chunk + 1);
+  }
+  time = times[frame];
+  decode(mags);
+  return true;
+}
@@ -0,0 +1,119 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Spectrogram recording file:
+//   header: "SPGR", version, bits per bin, number of bins (uint32), min and max dB (float32),
+//           start time in ms since epoch (uint64), bin frequencies (float32 each)
+//   chunks: number of frames, compressed size (uint32), zlib payload of the frame times (float64
+//           each, seconds since the first frame) and the quantized frames; every quantized bin is
+//           stored as the difference with the same bin of the previous frame in the chunk
+//   index:  per chunk first and last time (float64), file offset (uint64), number of frames
+//           (uint32), followed by the index offset (uint64), number of chunks (uint32) and "SPGI"
+// A file without the index (e.g. after a crash) is still readable, the reader rebuilds the index by
+// walking the chunks.
+
+struct RecordingIndexEntry
+{
+  double firstTime;
+  double lastTime;
+  uint64_t offset;
+  uint32_t frames;
+};
+
+// Records frames on a background thread. Memory is bounded by a fixed pool of chunk buffers: if
+// the disk cannot keep up the frames are dropped instead of blocking the caller. The destructor
+// does not wait for the disk either, the I/O thread writes the last frames and the index and closes
+// the file on its own.
+class Recorder
+{
+public:
+  // records the bins with frequencies in the displayed range, bits is 8 or 16
+  Recorder(const std::string &path, const std::vector<float> &freqs, int bits = 8);
+  ~Recorder();
+  Recorder(const Recorder &) = delete;
+  Recorder &operator=(const Recorder &) = delete;
+  // spectr covers all the freqs passed to the constructor; time is in seconds
+  auto push(const float *spectr, double time) -> void;
+  auto dropped() const -> unsigned long long { return io->droppedNum; }
+  // waits until the files of all the destroyed recorders are closed, before the process exits
+  static auto waitClosed() -> void;
+
+private:
+  struct Chunk
+  {
+    std::vector<double> times;
+    std::vector<float> mags;
+  };
+  // the state of the I/O thread, which outlives the recorder until the file is closed
+  struct Io
+  {
+    auto run() -> void;
+    auto write(const Chunk &) -> void;
+    auto close() -> void;
+
+    FILE *f;
+    int bits;
+    int bins;
+    std::vector<Chunk> chunks;
+    std::vector<int> freeChunks;
+    std::vector<int> fullChunks;
+    int current = -1;
+    std::mutex mutex;
+    std::condition_variable cv;
+    bool done = false;
+    std::atomic<unsigned long long> droppedNum{0};
+    std::vector<uint8_t> quantized;
+    std::vector<uint8_t> compressed;
+    std::vector<RecordingIndexEntry> index;
+  };
+
+  int from;
+  int bins;
+  double firstTime = -1;
+  std::shared_ptr<Io> io;
+};
+
+class RecordingReader
+{
+public:
+  RecordingReader(const std::string &path);
+  ~RecordingReader();
+  RecordingReader(const RecordingReader &) = delete;
+  RecordingReader &operator=(const RecordingReader &) = delete;
+  auto freqs() const -> const std::vector<float> & { return binFreqs; }
+  // wall clock time of the first frame, ms since epoch
+  auto startTime() const -> uint64_t { return start; }
+  auto duration() const -> double;
+  // positions the reader at the first frame at or after the time, only the chunk containing it is
+  // decoded
+  auto seek(double time) -> void;
+  // decodes the next frame magnitudes, returns false at the end of the recording
+  auto next(float *mags, double &time) -> bool;
+
+private:
+  auto load(int chunk) -> void;
+  auto decode(float *mags) -> void;
+  auto scan(long from) -> void;
+
+  FILE *f;
+  int bits;
+  float minDb;
+  float maxDb;
+  uint64_t start;
+  std::vector<float> binFreqs;
+  std::vector<RecordingIndexEntry> index;
+  int chunk = -1;
+  int frame = 0;
+  std::vector<double> times;
+  std::vector<int> q;
+  std::vector<uint8_t> payload;
+  std::vector<uint8_t> compressed;
+  std::vector<float> scratch;
+};
@@ -0,0 +1,203 @@
+#include "recording_tool.hpp"
+#include "config.hpp"
+#include "recording.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <log/log.hpp>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace
+{
+  const auto TestBins = 1024;
+
+  // the level in dB of every bin of every test frame, it covers the whole range of the recording
+  auto testDb(int frame, int k) -> float
+  {
+    return (frame * 7 + k * 3) % 160;
+  }
+
+  auto testTime(int frame) -> double
+  {
+    return frame * 0.01;
+  }
+
+  // reads the recording in order and after a few seeks, returns the number of frames which decode
+  // to the pattern, -1 on the first frame which does not
+  auto check(const std::string &path, const std::vector<float> &freqs, int bits) -> int
+  {
+    RecordingReader reader(path);
+    const auto &recorded = reader.freqs();
+    const auto from = std::lower_bound(std::begin(freqs), std::end(freqs), recorded.front()) - std::begin(freqs);
+    if (recorded.empty() || !std::equal(std::begin(recorded), std::end(recorded), std::begin(freqs) + from))
+    {
+      printf("%s: wrong bin frequencies\n", path.c_str());
+      return -1;
+    }
+    // half a quantization step and the rounding of the float
+    const auto tolerance = 160.f / ((1 << bits) - 1) / 2 + 1e-3f;
+    std::vector<float> mags(recorded.size());
+    const auto isValid = [&](int frame, double time) {
+      if (time != testTime(frame))
+      {
+        printf("%s: frame %d at %g s instead of %g s\n", path.c_str(), frame, time, testTime(frame));
+        return false;
+      }
+      for (auto k = 0U; k < mags.size(); ++k)
+        if (fabsf(20 * log10f(mags[k]) - testDb(frame, from + k)) > tolerance)
+        {
+          printf("%s: frame %d bin %u is %.2f dB instead of %.2f dB\n",
+                 path.c_str(),
+                 frame,
+                 k,
+                 20 * log10f(mags[k]),
+                 testDb(frame, from + k));
+          return false;
+        }
+      return true;
+    };
+
+    auto framesNum = 0;
+    for (auto time = 0.; reader.next(mags.data(), time); ++framesNum)
+      if (!isValid(framesNum, time))
+        return -1;
+    if (framesNum == 0)
+      return 0;
+    if (reader.duration() != testTime(framesNum - 1))
+    {
+      printf("%s: %d frames over %g s\n", path.c_str(), framesNum, reader.duration());
+      return -1;
+    }
+    // on a frame, between two frames, backwards, the first and the last one
+    for (const auto frame : {framesNum / 2, framesNum / 3, 0, framesNum - 1, 1, framesNum * 3 / 4})
+      for (const auto time : {testTime(frame), testTime(frame) - 0.005})
+      {
+        reader.seek(time);
+        auto t = 0.;
+        if (!reader.next(mags.data(), t) || !isValid(frame, t))
+        {
+          printf("%s: seek to %g s failed\n", path.c_str(), time);
+          return -1;
+        }
+      }
+    reader.seek(testTime(framesNum));
+    auto t = 0.;
+    if (reader.next(mags.data(), t))
+    {
+      printf("%s: a frame after the end at %g s\n", path.c_str(), t);
+      return -1;
+    }
+    return framesNum;
+  }
+
+  // the first size bytes of the file
+  auto copyHead(const std::string &from, const std::string &to, long size) -> bool
+  {
+    auto in = fopen(from.c_str(), "rb");
+    auto out = fopen(to.c_str(), "wb");
+    auto res = in && out;
+    std::vector<char> data(size);
+    res = res && fread(data.data(), 1, size, in) == static_cast<std::size_t>(size) &&
+          fwrite(data.data(), 1, size, out) == static_cast<std::size_t>(size);
+    if (in)
+      fclose(in);
+    if (out)
+      fclose(out);
+    return res;
+  }
+} // namespace
+
+auto recordingTestUsage() -> const char *
+{
+  return "[--frames <n>] [--bits <8|16>] [--rate <frames per second>]";
+}
+
+auto recordingTest(int argc, const char *argv[]) -> int
+{
+  auto framesNum = 1000;
+  auto bits = 8;
+  // the recorder drops the frames the disk cannot keep up with, the live analysis runs at about 47
+  auto rate = 1000;
+  for (auto i = 2; i + 1 < argc; i += 2)
+    if (strcmp(argv[i], "--frames") == 0)
+      framesNum = std::stoi(argv[i + 1]);
+    else if (strcmp(argv[i], "--bits") == 0)
+      bits = std::stoi(argv[i + 1]);
+    else if (strcmp(argv[i], "--rate") == 0)
+      rate = std::stoi(argv[i + 1]);
+  if (framesNum < 2 || (bits != 8 && bits != 16) || rate <= 0)
+  {
+    LOG("Usage:", argv[0], "--recording-test", recordingTestUsage());
+    return 1;
+  }
+  const auto path = "/tmp/spectrogram-test-" + std::to_string(getpid()) + ".spgr";
+  std::vector<float> freqs(TestBins);
+  for (auto k = 0; k < TestBins; ++k)
+    freqs[k] = 1.f * k * config().sampleFreq / 2 / TestBins;
+
+  auto dropped = 0ULL;
+  {
+    Recorder recorder(path, freqs, bits);
+    std::vector<float> spectr(TestBins);
+    const auto t1 = std::chrono::steady_clock::now();
+    for (auto frame = 0; frame < framesNum; ++frame)
+    {
+      std::this_thread::sleep_until(t1 + std::chrono::microseconds(frame * 1'000'000LL / rate));
+      for (auto k = 0; k < TestBins; ++k)
+        spectr[k] = powf(10.f, testDb(frame, k) / 20.f);
+      recorder.push(spectr.data(), testTime(frame));
+    }
+    dropped = recorder.dropped();
+  }
+  Recorder::waitClosed();
+
+  auto res = 0;
+  if (dropped > 0)
+  {
+    printf("the recorder dropped %llu frames, try a lower --rate\n", dropped);
+    res = 1;
+  }
+  const auto full = res == 0 ? check(path, freqs, bits) : -1;
+  printf("%s: %d of %d frames\n", path.c_str(), full, framesNum);
+  if (full != framesNum)
+    res = 1;
+
+  // the chunks end where the index starts, the last entry of the index is the last chunk
+  auto indexOffset = uint64_t{0};
+  RecordingIndexEntry last{};
+  if (auto f = fopen(path.c_str(), "rb"))
+  {
+    // an entry is 28 bytes, the offset of the index, the number of chunks and the magic 16
+    if (fseek(f, -16 - 28, SEEK_END) != 0 || fread(&last.firstTime, sizeof(last.firstTime), 1, f) != 1 ||
+        fread(&last.lastTime, sizeof(last.lastTime), 1, f) != 1 ||
+        fread(&last.offset, sizeof(last.offset), 1, f) != 1 || fread(&last.frames, sizeof(last.frames), 1, f) != 1 ||
+        fread(&indexOffset, sizeof(indexOffset), 1, f) != 1)
+      indexOffset = 0;
+    fclose(f);
+  }
+  const auto unindexed = path + ".unindexed";
+  const auto cut = path + ".cut";
+  if (res == 0 && indexOffset > last.offset && copyHead(path, unindexed, indexOffset) &&
+      copyHead(path, cut, (last.offset + indexOffset) / 2))
+  {
+    const auto unindexedNum = check(unindexed, freqs, bits);
+    printf("%s: %d of %d frames\n", unindexed.c_str(), unindexedNum, framesNum);
+    // the cut chunk is lost, the ones before it are not
+    const auto cutNum = check(cut, freqs, bits);
+    printf("%s: %d of %d frames\n", cut.c_str(), cutNum, framesNum);
+    if (unindexedNum != framesNum || cutNum != framesNum - static_cast<int>(last.frames))
+      res = 1;
+  }
+  else
+    res = 1;
+  remove(path.c_str());
+  remove(unindexed.c_str());
+  remove(cut.c_str());
+  printf("recording round trip of %d frames of %d bits: %s\n", framesNum, bits, res == 0 ? "ok" : "FAILED");
+  return res;
+}
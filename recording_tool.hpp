@@ -0,0 +1,9 @@
+#pragma once
+
+// Round trip of a recording: records patterned frames, checks that the reader decodes every one of
+// them within the quantization step both in order and after seeks, then again from a copy without
+// the index and from one cut in the middle of the last chunk, as a crash leaves them:
+// spectrogram --recording-test [--frames <n>] [--bits <8|16>] [--rate <frames per second>]
+auto recordingTest(int argc, const char *argv[]) -> int;
+// the arguments after --recording-test
+auto recordingTestUsage() -> const char *;
@@ -1,5 +1,8 @@
 #include "rend.hpp"
+#include "config.hpp"
 #include "consts.hpp"
+#include "profiler.hpp"
+#include <algorithm>
 #include <log/log.hpp>
 
 #include <sdlpp/sdlpp.hpp>
@@ -10,8 +13,16 @@
 
 #include <GL/glu.h>
 
-const auto LinesNum = 5 * 30;
-const auto Strade = EndFreq * SpectrSize / SampleFreq;
+auto toString(Layout value) -> const char *
+{
+  switch (value)
+  {
+  case Layout::Stack: return "stack";
+  case Layout::Overlay: return "overlay";
+  case Layout::Count: break;
+  }
+  return "unknown";
+}
 
 static auto printProgramLog(GLuint program) -> void
 {
@@ -160,14 +171,14 @@ Rend::Rend(sdl::Window &window) : ctx(SDL_GL_CreateContext(window.get()))
     #version 140
 
     in vec3 LVertexPos3D;
+    uniform float startFreq;
+    uniform float endFreq;
 
     out vec4 color;
     void main()
     {
-      float StartFreq = 55;
-      float EndFreq = 2 * 880;
       float freq = LVertexPos3D.x;
-      float x = log(freq / StartFreq) / log(EndFreq / StartFreq) * 2 - 1;
+      float x = log(freq / startFreq) / log(endFreq / startFreq) * 2 - 1;
       gl_Position = vec4(x, LVertexPos3D.y / 4 - 0.75, 0, 1);
 
       float fNote = log(freq / 55 * 2) / log(2.0) * 12.0 + 0.5;
@@ -196,13 +207,13 @@ Rend::Rend(sdl::Window &window) : ctx(SDL_GL_CreateContext(window.get()))
                                R"(
     #version 140
     in vec4 color;
+    uniform float gridStep;
     out vec4 LFragment;
     void main()
     {
-      const float N = 1920. / 12. / 5.;
       vec2 screenPos = gl_FragCoord.xy;
 
-      if (int(mod(screenPos.x, N)) == 0)
+      if (int(mod(screenPos.x, gridStep)) == 0)
         LFragment = mix(vec4(0.0, 0.0, 0.0, 1.0), color, 0.6);
       else
         LFragment = color;
@@ -213,22 +224,45 @@ Rend::Rend(sdl::Window &window) : ctx(SDL_GL_CreateContext(window.get()))
     #version 140
 
     in vec3 LVertexPos3D;
-    uniform float offset;
-    float LinesNum = 5 * 30;
+    uniform float startFreq;
+    uniform float endFreq;
 
-    out vec4 color;
+    out vec2 pos;
     void main()
     {
-      float StartFreq = 55;
-      float EndFreq = 2 * 880;
-      float freq = LVertexPos3D.x;
-      float x = log(freq / StartFreq) / log(EndFreq / StartFreq) * 2 - 1;
-      float y = (LVertexPos3D.y - offset) * 2 * 0.75 - 0.5;
+      pos = LVertexPos3D.xy;
+      gl_Position = vec4(LVertexPos3D.xy, 0, 1);
+    }
+  )",
+                                      R"(
+    #version 140
+    in vec2 pos;
+    uniform float offset;
+    uniform sampler2D waterfall;
+    uniform sampler1D binMap;
+    uniform float startFreq;
+    uniform float endFreq;
+    uniform float linesNum;
+    out vec4 LFragment;
+    void main()
+    {
+      float y = pos.y;
+      if (y < -0.5 + 2.0 / linesNum || y > 1.0 - 2.0 / linesNum)
+      {
+        LFragment = vec4(0, 0, 0, 0);
+        return;
+      }
+      float t = (pos.x + 1) / 2;
+      float freq = startFreq * pow(endFreq / startFreq, t);
+      // offset is the row origin of the ring of lines in the texture
+      float row = (floor(fract((y + 0.5) / 1.5 + offset) * linesNum) + 0.5) / linesNum;
+      float bin = texture(binMap, t).r;
+      float z = texture(waterfall, vec2((bin + 0.5) / float(textureSize(waterfall, 0).x), row)).r;
 
       float fNote = log(freq / 55 * 2) / log(2.0) * 12.0 + 0.5;
       int note = int(fNote);
       fNote = abs((fNote - note - 0.5) * 2);
-      float v = pow(LVertexPos3D.z, 2 - (freq - StartFreq) / (EndFreq - StartFreq));
+      float v = pow(z, 2 - (freq - startFreq) / (endFreq - startFreq));
       vec4 c;
       switch (note % 12)
       {
@@ -245,24 +279,7 @@ Rend::Rend(sdl::Window &window) : ctx(SDL_GL_CreateContext(window.get()))
         case 1: c = vec4(1, 0, 1, 1); break;
         case 8: c = vec4(1, 0, 0.5, 1); break;
       }
-      color = vec4(c.r * v * (1 - fNote) + v * fNote, c.g * v * (1 - fNote) + v * fNote, c.b * v * (1 - fNote) + v * fNote, v);
-
-      if (y < -0.5)
-        y += 2 * 0.75;
-
-      if (y < -0.5 + 2.0 / LinesNum && y >= -0.5 || y > 1.0 - 2.0 / LinesNum)
-        color = vec4(0, 0, 0, 0);
-
-      gl_Position = vec4(x, y, 0, 1);
-    }
-  )",
-                                      R"(
-    #version 140
-    in vec4 color;
-    out vec4 LFragment;
-    void main()
-    {
-      LFragment = color;
+      LFragment = vec4(c.r * v * (1 - fNote) + v * fNote, c.g * v * (1 - fNote) + v * fNote, c.b * v * (1 - fNote) + v * fNote, v);
     }
   )");
 
@@ -270,14 +287,14 @@ Rend::Rend(sdl::Window &window) : ctx(SDL_GL_CreateContext(window.get()))
     #version 140
 
     in vec3 LVertexPos3D;
+    uniform float startFreq;
+    uniform float endFreq;
 
     out vec4 color;
     void main()
     {
-      float StartFreq = 55;
-      float EndFreq = 2 * 880;
       float freq = LVertexPos3D.x;
-      float x = log(freq / StartFreq) / log(EndFreq / StartFreq) * 2 - 1;
+      float x = log(freq / startFreq) / log(endFreq / startFreq) * 2 - 1;
       gl_Position = vec4(x, LVertexPos3D.y / 4 - 0.75, 0, 1);
       color = vec4(LVertexPos3D.z, LVertexPos3D.z, LVertexPos3D.z, 1.0);
     }
@@ -285,13 +302,13 @@ Rend::Rend(sdl::Window &window) : ctx(SDL_GL_CreateContext(window.get()))
                               R"(
     #version 140
     in vec4 color;
+    uniform float gridStep;
     out vec4 LFragment;
     void main()
     {
-      const float N = 1920. / 12. / 5.;
       vec2 screenPos = gl_FragCoord.xy;
 
-      if (int(mod(screenPos.x, N)) == 0)
+      if (int(mod(screenPos.x, gridStep)) == 0)
         LFragment = mix(vec4(1.0, 0.0, 0.0, 1.0), color, 0.8);
       else
         LFragment = color;
@@ -302,14 +319,14 @@ Rend::Rend(sdl::Window &window) : ctx(SDL_GL_CreateContext(window.get()))
     #version 140
 
     in vec3 LVertexPos3D;
+    uniform float startFreq;
+    uniform float endFreq;
 
     out vec4 color;
     void main()
     {
-      float StartFreq = 55;
-      float EndFreq = 2 * 880;
       float freq = LVertexPos3D.x;
-      float x = log(freq / StartFreq) / log(EndFreq / StartFreq) * 2 - 1;
+      float x = log(freq / startFreq) / log(endFreq / startFreq) * 2 - 1;
       gl_Position = vec4(x, LVertexPos3D.y * 1.5 - 0.5, 0, 1);
       color = vec4(LVertexPos3D.z, LVertexPos3D.z, LVertexPos3D.z, 1.0);
     }
@@ -320,9 +337,51 @@ Rend::Rend(sdl::Window &window) : ctx(SDL_GL_CreateContext(window.get()))
     out vec4 LFragment;
     void main()
     {
-      const float N = 1920. / 12. / 5.;
-      vec2 screenPos = gl_FragCoord.xy;
+      LFragment = color;
+    }
+  )");
+
+  // the sounding notes in their colors over the lower keyboard, more opaque the more certain
+  notesPid = makeProgram(R"(
+    #version 140
+
+    in vec3 LVertexPos3D;
+    uniform float startFreq;
+    uniform float endFreq;
+
+    out vec4 color;
+    void main()
+    {
+      float freq = LVertexPos3D.x;
+      float x = log(freq / startFreq) / log(endFreq / startFreq) * 2 - 1;
+      gl_Position = vec4(x, LVertexPos3D.y / 4 - 0.75, 0, 1);
 
+      int note = int(log(freq / 55 * 2) / log(2.0) * 12.0 + 0.5);
+      vec4 c;
+      switch (note % 12)
+      {
+        case 3: c = vec4(1, 0, 0, 1); break;
+        case 10: c = vec4(1, 0.5, 0, 1); break;
+        case 5: c = vec4(1, 1, 0, 1); break;
+        case 0: c = vec4(0.5, 1, 0, 1); break;
+        case 7: c = vec4(0, 1, 0, 1); break;
+        case 2: c = vec4(0, 1, 0.5, 1); break;
+        case 9: c = vec4(0, 1, 1, 1); break;
+        case 4: c = vec4(0, 0.5, 1, 1); break;
+        case 11: c = vec4(0, 0, 1, 1); break;
+        case 6: c = vec4(0.5, 0, 1, 1); break;
+        case 1: c = vec4(1, 0, 1, 1); break;
+        case 8: c = vec4(1, 0, 0.5, 1); break;
+      }
+      color = vec4(c.rgb, LVertexPos3D.z * 0.8);
+    }
+  )",
+                         R"(
+    #version 140
+    in vec4 color;
+    out vec4 LFragment;
+    void main()
+    {
       LFragment = color;
     }
   )");
@@ -343,290 +402,484 @@ Rend::Rend(sdl::Window &window) : ctx(SDL_GL_CreateContext(window.get()))
     LOG("Offset is not a valid glsl program variable!");
   }
 
-  // Initialize clear color
-  glClearColor(0.f, 0.f, 0.f, 1.f);
+  glUseProgram(rollingSpectrogramPid);
   ERROR_CHECK();
-
-  glGenBuffers(1, &vbo);
+  glUniform1i(glGetUniformLocation(rollingSpectrogramPid, "waterfall"), 0);
   ERROR_CHECK();
-
-  glGenBuffers(1, &lowerPianoVbo);
+  glUniform1i(glGetUniformLocation(rollingSpectrogramPid, "binMap"), 1);
   ERROR_CHECK();
-
-  glGenBuffers(1, &upperPianoVbo);
+  glUseProgram(0);
   ERROR_CHECK();
 
-  glGenBuffers(1, &spectrogramVbo);
-  ERROR_CHECK();
-  glBindBuffer(GL_ARRAY_BUFFER, spectrogramVbo);
+  // Initialize clear color
+  glClearColor(0.f, 0.f, 0.f, 1.f);
   ERROR_CHECK();
-  for (int j = 0; j < LinesNum; ++j)
-    for (int i = 0; i < Strade; ++i)
-    {
-      const auto freq = 1.f * i * SampleFreq / SpectrSize;
-      spectrogramData.push_back(freq);
-      spectrogramData.push_back(1.f * j / LinesNum);
-      spectrogramData.push_back(0);
-      spectrogramData.push_back(freq);
-      //      spectrogramData.push_back(1.f * (j + 1) / LinesNum);
-      spectrogramData.push_back(1.f * (j + 1) / LinesNum);
-      spectrogramData.push_back(0);
-    }
+
+  hasTimerQuery = GLEW_ARB_timer_query;
+  initGpuTimer(pianoTimer, "gpu pianos");
+  initGpuTimer(spectrumTimer, "gpu spectrum");
+  initGpuTimer(waterfallTimer, "gpu waterfall");
 
   // Create IBO
   glGenBuffers(1, &ibo);
   ERROR_CHECK();
-  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
-  ERROR_CHECK();
 
-  for (int j = 0; j < LinesNum; ++j)
-    for (int i = 0; i < Strade - 2; ++i)
-    {
-      indexData.push_back(2 * j * Strade + i * 2 + 0);
-      indexData.push_back(2 * j * Strade + i * 2 + 3);
-      indexData.push_back(2 * j * Strade + i * 2 + 1);
-      indexData.push_back(2 * j * Strade + i * 2 + 0);
-      indexData.push_back(2 * j * Strade + i * 2 + 2);
-      indexData.push_back(2 * j * Strade + i * 2 + 3);
-    }
+  initBatch(lowerPiano);
+  initBatch(upperPiano);
+  buildPiano(upperPiano, 0.063f);
 
-  glBufferData(
-    GL_ELEMENT_ARRAY_BUFFER, indexData.size() * sizeof(indexData[0]), indexData.data(), GL_STATIC_DRAW);
-  ERROR_CHECK();
-}
+  // the waterfall is a single quad, the fragment shader looks the lines up in the texture
+  initBatch(waterfall);
+  upload(waterfall, {-1.f, -0.5f, 0.f, -1.f, 1.f, 0.f, 1.f, -0.5f, 0.f, 1.f, 1.f, 0.f}, GL_STATIC_DRAW);
+  waterfall.count = 6;
 
-void Rend::rend(std::vector<float> spectr, bool smartScale)
-{
-  constexpr bool isWhite[] = {
-    true, false, true, true, false, true, false, true, true, false, true, false};
-  glClear(GL_COLOR_BUFFER_BIT);
-  ERROR_CHECK();
-  glEnable(GL_BLEND);
+  glGenTextures(1, &mixTex);
   ERROR_CHECK();
-  glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+  glGenTextures(1, &binMapTex);
   ERROR_CHECK();
 
+  applyConfig();
+  std::vector<float> linearFreqs;
+  for (int i = 0; i < config().spectrSize / 2; ++i)
+    linearFreqs.push_back(1.f * i * config().sampleFreq / config().spectrSize);
+  setFreqs(std::move(linearFreqs));
+  setLanes(1);
+}
+
+auto Rend::setLanes(int value) -> void
+{
+  while (static_cast<int>(lanes.size()) > value)
   {
-    glBindBuffer(GL_ARRAY_BUFFER, upperPianoVbo);
+    glDeleteTextures(1, &lanes.back().waterfallTex);
     ERROR_CHECK();
-    std::vector<float> pianoData;
-    const auto w = 0.063f;
-    for (int i = 0; i < 49 + 12; ++i)
+    for (auto *batch : {&lanes.back().spectrum, &lanes.back().notes})
     {
-      const auto freq1 = 55 * powf(2, (i - .46f) / 12.f);
-      pianoData.push_back(freq1);
-      pianoData.push_back(0);
-      pianoData.push_back(isWhite[i % 12] ? w : 0);
-      pianoData.push_back(freq1);
-      pianoData.push_back(1);
-      pianoData.push_back(isWhite[i % 12] ? w : 0);
-
-      const auto freq2 = 55 * powf(2, (i + .46f) / 12.f);
-      pianoData.push_back(freq2);
-      pianoData.push_back(0);
-      pianoData.push_back(isWhite[i % 12] ? w : 0);
-      pianoData.push_back(freq2);
-      pianoData.push_back(1);
-      pianoData.push_back(isWhite[i % 12] ? w : 0);
-
-      const auto freq3 = 55 * powf(2, (i + .50f) / 12.f);
-      pianoData.push_back(freq3);
-      pianoData.push_back(0);
-      pianoData.push_back(0);
-      pianoData.push_back(freq3);
-      pianoData.push_back(1);
-      pianoData.push_back(0);
+      glDeleteBuffers(1, &batch->vbo);
+      ERROR_CHECK();
+      glDeleteVertexArrays(1, &batch->vao);
+      ERROR_CHECK();
     }
-    glBufferData(GL_ARRAY_BUFFER, pianoData.size() * sizeof(GLfloat), pianoData.data(), GL_STATIC_DRAW);
+    lanes.pop_back();
+  }
+  while (static_cast<int>(lanes.size()) < value)
+  {
+    lanes.emplace_back();
+    initBatch(lanes.back().spectrum);
+    initBatch(lanes.back().notes);
+    lanes.back().shownNotes.resize(PianoKeys);
+    glGenTextures(1, &lanes.back().waterfallTex);
     ERROR_CHECK();
+  }
+  line = 0;
+  initWaterfalls();
+}
 
-    glUseProgram(upperPianoPid);
-    ERROR_CHECK();
-    glBindBuffer(GL_ARRAY_BUFFER, upperPianoVbo);
-    ERROR_CHECK();
-    glVertexAttribPointer(vertexPos3DLocation, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat), NULL);
-    ERROR_CHECK();
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
-    ERROR_CHECK();
-    glEnableVertexAttribArray(vertexPos3DLocation);
+auto Rend::setLayout(Layout value) -> void
+{
+  currentLayout = value;
+}
+
+auto Rend::layout() const -> Layout
+{
+  return currentLayout;
+}
+
+auto Rend::initWaterfalls() -> void
+{
+  // one line of bins per row, the rows are a ring with the origin in the offset uniform
+  const std::vector<float> zeros(strade * LinesNum);
+  glActiveTexture(GL_TEXTURE0);
+  ERROR_CHECK();
+  for (auto i = 0; i <= static_cast<int>(lanes.size()); ++i)
+  {
+    glBindTexture(GL_TEXTURE_2D, i < static_cast<int>(lanes.size()) ? lanes[i].waterfallTex : mixTex);
     ERROR_CHECK();
-    glDrawElements(GL_TRIANGLES, 3 * (49 + 12) * 6, GL_UNSIGNED_INT, NULL);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, strade, LinesNum, 0, GL_RED, GL_FLOAT, zeros.data());
     ERROR_CHECK();
-    glDisableVertexAttribArray(vertexPos3DLocation);
+    uploadedBytes += zeros.size() * sizeof(float);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
     ERROR_CHECK();
   }
+}
+
+auto Rend::applyConfig() -> void
+{
+  const auto &c = config();
+  glViewport(0, 0, c.width, c.height);
+  ERROR_CHECK();
+  // the shaders get the same values the CPU side uses
+  for (const auto pid : {spectrogramPid, rollingSpectrogramPid, lowerPianoPid, upperPianoPid, notesPid})
   {
-    glBindBuffer(GL_ARRAY_BUFFER, lowerPianoVbo);
-    ERROR_CHECK();
-    std::vector<float> pianoData;
-    const auto w = smartScale ? 0.25f : 0.5f;
-    for (int i = 0; i < 49 + 12; ++i)
-    {
-      const auto freq1 = 55 * powf(2, (i - .46f) / 12.f);
-      pianoData.push_back(freq1);
-      pianoData.push_back(0);
-      pianoData.push_back(isWhite[i % 12] ? w : 0);
-      pianoData.push_back(freq1);
-      pianoData.push_back(1);
-      pianoData.push_back(isWhite[i % 12] ? w : 0);
-
-      const auto freq2 = 55 * powf(2, (i + .46f) / 12.f);
-      pianoData.push_back(freq2);
-      pianoData.push_back(0);
-      pianoData.push_back(isWhite[i % 12] ? w : 0);
-      pianoData.push_back(freq2);
-      pianoData.push_back(1);
-      pianoData.push_back(isWhite[i % 12] ? w : 0);
-
-      const auto freq3 = 55 * powf(2, (i + .50f) / 12.f);
-      pianoData.push_back(freq3);
-      pianoData.push_back(0);
-      pianoData.push_back(0);
-      pianoData.push_back(freq3);
-      pianoData.push_back(1);
-      pianoData.push_back(0);
-    }
-    glBufferData(GL_ARRAY_BUFFER, pianoData.size() * sizeof(GLfloat), pianoData.data(), GL_STATIC_DRAW);
+    glUseProgram(pid);
     ERROR_CHECK();
+    const auto set = [pid](const char *name, float value) {
+      const auto location = glGetUniformLocation(pid, name);
+      if (location >= 0)
+        glUniform1f(location, value);
+      ERROR_CHECK();
+    };
+    set("startFreq", c.startFreq);
+    set("endFreq", c.endFreq);
+    set("gridStep", c.width / 12.f / 5.f);
+    set("linesNum", LinesNum);
+  }
+  glUseProgram(0);
+  ERROR_CHECK();
+  // the profiler may be enabled at any frame, the render thread takes its rings now
+  for (const auto name : {"upload", "upload line", "vertices"})
+    Profiler::instance().reserve(name);
+}
 
-    glUseProgram(lowerPianoPid);
-    ERROR_CHECK();
-    glBindBuffer(GL_ARRAY_BUFFER, lowerPianoVbo);
-    ERROR_CHECK();
-    glVertexAttribPointer(vertexPos3DLocation, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat), NULL);
-    ERROR_CHECK();
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
-    ERROR_CHECK();
-    glEnableVertexAttribArray(vertexPos3DLocation);
-    ERROR_CHECK();
-    glDrawElements(GL_TRIANGLES, 3 * (49 + 12) * 6, GL_UNSIGNED_INT, NULL);
-    ERROR_CHECK();
-    glDisableVertexAttribArray(vertexPos3DLocation);
-    ERROR_CHECK();
+auto Rend::setFreqs(std::vector<float> value) -> void
+{
+  const auto &c = config();
+  freqs = std::move(value);
+  const auto idx = [this](float freq) {
+    return static_cast<int>(std::lower_bound(std::begin(freqs), std::end(freqs), freq) - std::begin(freqs));
+  };
+  strade = std::min(idx(c.endFreq) + 1, static_cast<int>(freqs.size()));
+  line = 0;
+  initWaterfalls();
+
+  // screen column to fractional bin index, the bins do not have to be linear in frequency
+  std::vector<float> binMap(c.width);
+  for (int px = 0; px < c.width; ++px)
+  {
+    const auto freq = c.startFreq * powf(c.endFreq / c.startFreq, (px + .5f) / c.width);
+    const auto k = std::clamp(idx(freq), 1, strade - 1);
+    binMap[px] = std::clamp(k - 1 + (freq - freqs[k - 1]) / (freqs[k] - freqs[k - 1]), 0.f, strade - 1.f);
   }
+  glActiveTexture(GL_TEXTURE1);
+  ERROR_CHECK();
+  glBindTexture(GL_TEXTURE_1D, binMapTex);
+  ERROR_CHECK();
+  glTexImage1D(GL_TEXTURE_1D, 0, GL_R32F, c.width, 0, GL_RED, GL_FLOAT, binMap.data());
+  ERROR_CHECK();
+  uploadedBytes += binMap.size() * sizeof(float);
+  glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  ERROR_CHECK();
+  glActiveTexture(GL_TEXTURE0);
+  ERROR_CHECK();
 
-  glUseProgram(spectrogramPid);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
   ERROR_CHECK();
 
-  // VBO data
-  vertexData.clear();
+  // a strip of quads between consecutive pairs of vertices, shared by the live spectrum and the
+  // piano overlays
+  indexData.clear();
+  for (int i = 0; i < std::max(strade, PianoKeys * 3 + 1) - 1; ++i)
+  {
+    indexData.push_back(i * 2 + 0);
+    indexData.push_back(i * 2 + 3);
+    indexData.push_back(i * 2 + 1);
+    indexData.push_back(i * 2 + 0);
+    indexData.push_back(i * 2 + 2);
+    indexData.push_back(i * 2 + 3);
+  }
+
+  glBufferData(
+    GL_ELEMENT_ARRAY_BUFFER, indexData.size() * sizeof(indexData[0]), indexData.data(), GL_STATIC_DRAW);
+  ERROR_CHECK();
+  uploadedBytes += indexData.size() * sizeof(indexData[0]);
+
+  // the frames only refill the scratch buffers
+  vertexData.reserve(std::max(strade, PianoKeys * 3) * 6);
+  mix.resize(strade);
+}
 
-  // Set vertex data
-  glBindBuffer(GL_ARRAY_BUFFER, vbo);
+auto Rend::initBatch(Batch &batch) -> void
+{
+  glGenVertexArrays(1, &batch.vao);
+  ERROR_CHECK();
+  glGenBuffers(1, &batch.vbo);
+  ERROR_CHECK();
+  glBindVertexArray(batch.vao);
+  ERROR_CHECK();
+  glBindBuffer(GL_ARRAY_BUFFER, batch.vbo);
   ERROR_CHECK();
   glVertexAttribPointer(vertexPos3DLocation, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat), NULL);
   ERROR_CHECK();
+  glEnableVertexAttribArray(vertexPos3DLocation);
+  ERROR_CHECK();
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
+  ERROR_CHECK();
+  glBindVertexArray(0);
+  ERROR_CHECK();
+}
+
+auto Rend::upload(Batch &batch, const std::vector<float> &data, unsigned usage) -> void
+{
+  ScopedTimer timer("upload");
+  glBindBuffer(GL_ARRAY_BUFFER, batch.vbo);
+  ERROR_CHECK();
+  glBufferData(GL_ARRAY_BUFFER, data.size() * sizeof(GLfloat), data.data(), usage);
+  ERROR_CHECK();
+  uploadedBytes += data.size() * sizeof(GLfloat);
+}
 
-  const auto startIdx = StartFreq / 2 * SpectrSize / SampleFreq;
-  const auto endIdx = EndFreq * 2 * SpectrSize / SampleFreq;
+auto Rend::initGpuTimer(GpuTimer &timer, const char *name) -> void
+{
+  timer.name = name;
+  if (!hasTimerQuery)
+    return;
+  glGenQueries(GpuTimer::Depth, timer.queries);
+  ERROR_CHECK();
+  // the first result arrives Depth frames late, long after the render loop stopped allocating
+  Profiler::instance().reserve(name);
+}
 
-  std::vector<float> poly;
-  auto max = 0.f;
-  if (smartScale)
+auto Rend::beginGpuTimer(GpuTimer &timer) -> void
+{
+  if (!hasTimerQuery || !Profiler::instance().isEnabled())
+    return;
+  // the query issued Depth frames ago has most likely finished, reading it does not stall
+  const auto query = timer.queries[timer.frames % GpuTimer::Depth];
+  if (timer.frames >= GpuTimer::Depth)
   {
-    float a = 0;
-    const auto filtK = 1.f / 64.f; // higher denominator harder filtering
-    for (auto s = startIdx; s < endIdx; ++s)
-    {
-      a = a + filtK * (spectr[s] - a);
-      poly.push_back(a);
-    }
-    max = 0;
-    for (auto s = endIdx - 1; s >= startIdx; --s)
+    GLint isAvailable = GL_FALSE;
+    glGetQueryObjectiv(query, GL_QUERY_RESULT_AVAILABLE, &isAvailable);
+    ERROR_CHECK();
+    if (isAvailable)
     {
-      a = a + filtK * (poly[s - startIdx] - a);
-      if (max < spectr[s] / a)
-        max = spectr[s] / a;
-      poly[s - startIdx] = a;
+      GLuint64 ns = 0;
+      glGetQueryObjectui64v(query, GL_QUERY_RESULT, &ns);
+      ERROR_CHECK();
+      Profiler::instance().add(timer.name, ns / 1000.f);
     }
   }
-  else
-  {
-    max = std::max(*std::max_element(std::begin(spectr) + StartFreq * SpectrSize / SampleFreq,
-                                     std::begin(spectr) + EndFreq * SpectrSize / SampleFreq),
-                   1.5E+4f);
-    for (int i = startIdx; i < endIdx; ++i)
-      poly.push_back(1);
-  }
+  glBeginQuery(GL_TIME_ELAPSED, query);
+  ERROR_CHECK();
+}
+
+auto Rend::endGpuTimer(GpuTimer &timer) -> void
+{
+  if (!hasTimerQuery || !Profiler::instance().isEnabled())
+    return;
+  glEndQuery(GL_TIME_ELAPSED);
+  ERROR_CHECK();
+  ++timer.frames;
+}
 
-  auto i = 0;
+auto Rend::drawBatch(const Batch &batch, unsigned pid) -> void
+{
+  glUseProgram(pid);
+  ERROR_CHECK();
+  glBindVertexArray(batch.vao);
+  ERROR_CHECK();
+  glDrawElements(GL_TRIANGLES, batch.count, GL_UNSIGNED_INT, NULL);
+  ERROR_CHECK();
+  glBindVertexArray(0);
+  ERROR_CHECK();
+}
 
-  for (auto a : spectr)
+auto Rend::buildPiano(Batch &batch, float w) -> void
+{
+  if (batch.param == w)
+    return;
+  constexpr bool isWhite[] = {
+    true, false, true, true, false, true, false, true, true, false, true, false};
+  // the scratch of the spectrum vertices is free between the frames
+  vertexData.clear();
+  for (int i = 0; i < PianoKeys; ++i)
   {
-    const auto freq = 1.f * i * SampleFreq / SpectrSize;
-    const auto tmp2 = (i >= startIdx && i < endIdx) ? poly[i - startIdx] : 1.0f;
-    const auto y = a / tmp2 / max;
-    // const auto y = tmp2 / max / 500000;
+    const auto freq1 = 55 * powf(2, (i - .46f) / 12.f);
+    vertexData.push_back(freq1);
+    vertexData.push_back(0);
+    vertexData.push_back(isWhite[i % 12] ? w : 0);
+    vertexData.push_back(freq1);
+    vertexData.push_back(1);
+    vertexData.push_back(isWhite[i % 12] ? w : 0);
+
+    const auto freq2 = 55 * powf(2, (i + .46f) / 12.f);
+    vertexData.push_back(freq2);
+    vertexData.push_back(0);
+    vertexData.push_back(isWhite[i % 12] ? w : 0);
+    vertexData.push_back(freq2);
+    vertexData.push_back(1);
+    vertexData.push_back(isWhite[i % 12] ? w : 0);
+
+    const auto freq3 = 55 * powf(2, (i + .50f) / 12.f);
+    vertexData.push_back(freq3);
+    vertexData.push_back(0);
+    vertexData.push_back(0);
+    vertexData.push_back(freq3);
+    vertexData.push_back(1);
+    vertexData.push_back(0);
+  }
+  upload(batch, vertexData, GL_STATIC_DRAW);
+  batch.count = (3 * PianoKeys - 1) * 6;
+  batch.param = w;
+}
 
+auto Rend::buildNotes(int lane, const std::vector<float> &notes) -> void
+{
+  auto &l = lanes[lane];
+  if (l.notes.count > 0 && std::equal(std::begin(notes), std::end(notes), std::begin(l.shownNotes)))
+    return;
+  std::copy(std::begin(notes), std::end(notes), std::begin(l.shownNotes));
+  // the keyboard geometry, the confidence instead of the key color
+  vertexData.clear();
+  const auto edge = [this](float freq, float z) {
     vertexData.push_back(freq);
-    vertexData.push_back(-1.f);
-
-    vertexData.push_back(y);
-
+    vertexData.push_back(0);
+    vertexData.push_back(z);
     vertexData.push_back(freq);
-    vertexData.push_back(y * 2.f - 1.f);
-    vertexData.push_back(y);
-
-    if (i < Strade)
-    {
-      spectrogramData[line * Strade * 6 + i * 6 + 2] = y;
-      spectrogramData[line * Strade * 6 + i * 6 + 5] = y;
-    }
-
-    ++i;
+    vertexData.push_back(1);
+    vertexData.push_back(z);
+  };
+  for (int i = 0; i < PianoKeys; ++i)
+  {
+    edge(55 * powf(2, (i - .46f) / 12.f), notes[i]);
+    edge(55 * powf(2, (i + .46f) / 12.f), notes[i]);
+    edge(55 * powf(2, (i + .50f) / 12.f), 0);
   }
-  line = (line + LinesNum - 1) % LinesNum;
-
-  glBufferData(GL_ARRAY_BUFFER, vertexData.size() * sizeof(GLfloat), vertexData.data(), GL_STATIC_DRAW);
-  ERROR_CHECK();
+  upload(l.notes, vertexData, GL_DYNAMIC_DRAW);
+  l.notes.count = (3 * PianoKeys - 1) * 6;
+}
 
-  // Enable vertex position
-  glEnableVertexAttribArray(vertexPos3DLocation);
-  ERROR_CHECK();
+auto Rend::uploaded() const -> size_t
+{
+  return lastUploadedBytes;
+}
 
-  // Set index data and render
-  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
+auto Rend::uploadLine(unsigned tex, const float *data) -> void
+{
+  glBindTexture(GL_TEXTURE_2D, tex);
   ERROR_CHECK();
-  glDrawElements(GL_TRIANGLES, (spectr.size() - 1) * 6, GL_UNSIGNED_INT, NULL);
+  ScopedTimer timer("upload line");
+  glTexSubImage2D(GL_TEXTURE_2D, 0, 0, line, strade, 1, GL_RED, GL_FLOAT, data);
   ERROR_CHECK();
+  uploadedBytes += strade * sizeof(GLfloat);
+}
 
-  // Disable vertex position
-  glDisableVertexAttribArray(vertexPos3DLocation);
+auto Rend::setBand(int band, int bands) -> void
+{
+  const auto &c = config();
+  const auto bottom = c.height * (bands - 1 - band) / bands;
+  glViewport(0, bottom, c.width, c.height * (bands - band) / bands - bottom);
   ERROR_CHECK();
+}
 
-  glUseProgram(rollingSpectrogramPid);
+auto Rend::rend(const std::vector<const std::vector<float> *> &spectra,
+               const std::vector<const std::vector<float> *> &notes,
+               bool smartScale) -> void
+{
+  glClear(GL_COLOR_BUFFER_BIT);
+  ERROR_CHECK();
+  glEnable(GL_BLEND);
+  ERROR_CHECK();
+  glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
   ERROR_CHECK();
+  const auto lanesNum = std::min(spectra.size(), lanes.size());
+  const auto isStack = currentLayout == Layout::Stack && lanesNum > 1;
+  const auto bands = isStack ? static_cast<int>(lanesNum) : 1;
 
-  if (offset >= 0)
+  // the keyboards only change with the smart scale mode
+  buildPiano(lowerPiano, smartScale ? 0.25f : 0.5f);
+  beginGpuTimer(pianoTimer);
+  for (auto band = 0; band < bands; ++band)
   {
-    glUniform1f(offset, 1.f * line / LinesNum);
-    ERROR_CHECK();
+    setBand(band, bands);
+    drawBatch(upperPiano, upperPianoPid);
+    drawBatch(lowerPiano, lowerPianoPid);
   }
+  endGpuTimer(pianoTimer);
 
-  glBindBuffer(GL_ARRAY_BUFFER, spectrogramVbo);
-  ERROR_CHECK();
-  glVertexAttribPointer(vertexPos3DLocation, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat), NULL);
-  ERROR_CHECK();
+  // the bins above the displayed range are off the screen
+  beginGpuTimer(spectrumTimer);
+  for (auto lane = 0U; lane < lanesNum; ++lane)
+  {
+    const auto &spectr = *spectra[lane];
+    {
+      ScopedTimer timer("vertices");
+      vertexData.clear();
+      for (auto i = 0; i < strade; ++i)
+      {
+        const auto freq = freqs[i];
+        const auto y = spectr[i];
 
-  glBufferData(
-    GL_ARRAY_BUFFER, spectrogramData.size() * sizeof(GLfloat), spectrogramData.data(), GL_STATIC_DRAW);
-  ERROR_CHECK();
+        vertexData.push_back(freq);
+        vertexData.push_back(-1.f);
 
-  // Enable vertex position
-  glEnableVertexAttribArray(vertexPos3DLocation);
+        vertexData.push_back(y);
+
+        vertexData.push_back(freq);
+        vertexData.push_back(y * 2.f - 1.f);
+        vertexData.push_back(y);
+      }
+    }
+    auto &spectrum = lanes[lane].spectrum;
+    upload(spectrum, vertexData, GL_STREAM_DRAW);
+    spectrum.count = (strade - 1) * 6;
+    setBand(isStack ? lane : 0, bands);
+    // overlaid channels keep the brighter color of each pixel
+    if (!isStack && lane == 1)
+    {
+      glBlendEquation(GL_MAX);
+      ERROR_CHECK();
+    }
+    drawBatch(spectrum, spectrogramPid);
+  }
+  glBlendEquation(GL_FUNC_ADD);
   ERROR_CHECK();
+  for (auto lane = 0U; lane < std::min(lanesNum, notes.size()); ++lane)
+  {
+    buildNotes(lane, *notes[lane]);
+    setBand(isStack ? lane : 0, bands);
+    drawBatch(lanes[lane].notes, notesPid);
+  }
+  endGpuTimer(spectrumTimer);
 
-  // Set index data and render
-  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
+  // only the newest line goes to the GPU
+  glActiveTexture(GL_TEXTURE0);
   ERROR_CHECK();
-  glDrawElements(GL_TRIANGLES, indexData.size(), GL_UNSIGNED_INT, NULL);
+  for (auto i = 0U; i < lanesNum; ++i)
+    uploadLine(lanes[i].waterfallTex, spectra[i]->data());
+  if (lanesNum > 1)
+  {
+    std::copy(spectra[0]->data(), spectra[0]->data() + strade, std::begin(mix));
+    for (auto i = 1U; i < lanesNum; ++i)
+      for (auto j = 0; j < strade; ++j)
+        mix[j] = std::max(mix[j], (*spectra[i])[j]);
+    uploadLine(mixTex, mix.data());
+  }
+  glActiveTexture(GL_TEXTURE1);
+  ERROR_CHECK();
+  glBindTexture(GL_TEXTURE_1D, binMapTex);
+  ERROR_CHECK();
+  glActiveTexture(GL_TEXTURE0);
   ERROR_CHECK();
+  line = (line + LinesNum - 1) % LinesNum;
 
-  // Disable vertex position
-  glDisableVertexAttribArray(vertexPos3DLocation);
+  glUseProgram(rollingSpectrogramPid);
   ERROR_CHECK();
 
+  if (offset >= 0)
+  {
+    glUniform1f(offset, 1.f * line / LinesNum);
+    ERROR_CHECK();
+  }
+  beginGpuTimer(waterfallTimer);
+  for (auto band = 0; band < bands; ++band)
+  {
+    const auto tex = isStack ? lanes[band].waterfallTex : lanesNum > 1 ? mixTex : lanes[0].waterfallTex;
+    glBindTexture(GL_TEXTURE_2D, tex);
+    ERROR_CHECK();
+    setBand(band, bands);
+    drawBatch(waterfall, rollingSpectrogramPid);
+  }
+  endGpuTimer(waterfallTimer);
+  setBand(0, 1);
+
   // Unbind program
   glUseProgram(NULL);
   ERROR_CHECK();
+  // geometry rebuilt between the frames is accounted to the next one
+  lastUploadedBytes = uploadedBytes;
+  uploadedBytes = 0;
 }
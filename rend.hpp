@@ -7,27 +7,108 @@ namespace sdl
   class Window;
 }
 
+// How several channels share the window
+enum class Layout {
+  Stack,   // a full view per channel, the first channel on top
+  Overlay, // one view, the spectra drawn over each other and the waterfall of their maximum
+  Count
+};
+
+auto toString(Layout) -> const char *;
+
 class Rend
 {
 public:
   Rend(sdl::Window &);
-  auto rend(std::vector<float> spectr, bool smartScale) -> void;
+  // one spectrum per lane, each has one value per bin of the last setFreqs(), normalized to 0..1;
+  // notes has the PianoKeys confidences of the sounding notes per lane, lit on the lower keyboard;
+  // smartScale only picks the lower keyboard; does not allocate, the calls below size everything a
+  // frame needs
+  auto rend(const std::vector<const std::vector<float> *> &spectra,
+            const std::vector<const std::vector<float> *> &notes,
+            bool smartScale) -> void;
+  // number of channels drawn, clears the waterfalls
+  auto setLanes(int) -> void;
+  auto setLayout(Layout) -> void;
+  auto layout() const -> Layout;
+  // picks up the window size and the frequency range of the config in effect, setFreqs() has to
+  // follow
+  auto applyConfig() -> void;
+  // frequencies of the spectrum bins, rebuilds the waterfall geometry
+  auto setFreqs(std::vector<float> freqs) -> void;
+  // bytes sent to the GPU by the last frame
+  auto uploaded() const -> size_t;
 
 private:
+  // a vertex buffer with its attribute layout, drawn with the shared index buffer
+  struct Batch
+  {
+    unsigned vao = 0;
+    unsigned vbo = 0;
+    int count = 0;
+    // the parameter the geometry was built for
+    float param = -1.f;
+  };
+  auto initBatch(Batch &) -> void;
+  auto upload(Batch &, const std::vector<float> &, unsigned usage) -> void;
+  auto drawBatch(const Batch &, unsigned pid) -> void;
+  auto buildPiano(Batch &, float w) -> void;
+  // rebuilt only when the notes changed
+  auto buildNotes(int lane, const std::vector<float> &notes) -> void;
+  // allocates and clears the waterfall textures for the current bins
+  auto initWaterfalls() -> void;
+  auto uploadLine(unsigned tex, const float *) -> void;
+  // the part of the window of the given band out of bands from the top
+  auto setBand(int band, int bands) -> void;
+  // GL_TIME_ELAPSED queries around a group of draws, reported to the Profiler a few frames late
+  struct GpuTimer
+  {
+    static const auto Depth = 4;
+    const char *name;
+    unsigned queries[Depth];
+    long long frames = 0;
+  };
+  auto initGpuTimer(GpuTimer &, const char *name) -> void;
+  auto beginGpuTimer(GpuTimer &) -> void;
+  auto endGpuTimer(GpuTimer &) -> void;
+
   void *ctx;
   unsigned spectrogramPid;
   unsigned lowerPianoPid;
   unsigned upperPianoPid;
+  unsigned notesPid;
   unsigned rollingSpectrogramPid;
   int offset;
   int vertexPos3DLocation;
-  unsigned vbo = 0;
-  unsigned lowerPianoVbo = 0;
-  unsigned upperPianoVbo = 0;
-  unsigned spectrogramVbo;
+  // the live spectrum, the lit keys and the waterfall texture of a channel
+  struct Lane
+  {
+    Batch spectrum;
+    Batch notes;
+    // the notes the batch was built for
+    std::vector<float> shownNotes;
+    unsigned waterfallTex = 0;
+  };
+  std::vector<Lane> lanes;
+  Layout currentLayout = Layout::Stack;
+  Batch lowerPiano;
+  Batch upperPiano;
+  Batch waterfall;
+  // the maximum over the lanes for the overlay layout
+  unsigned mixTex;
+  std::vector<float> mix;
+  unsigned binMapTex;
   unsigned ibo = 0;
   std::vector<float> vertexData;
-  std::vector<float> spectrogramData;
   std::vector<unsigned> indexData;
+  std::vector<float> freqs;
+  // number of bins on the screen
+  int strade;
   int line = 0;
+  bool hasTimerQuery = false;
+  GpuTimer pianoTimer;
+  GpuTimer spectrumTimer;
+  GpuTimer waterfallTimer;
+  size_t uploadedBytes = 0;
+  size_t lastUploadedBytes = 0;
 };
@@ -0,0 +1,62 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+// Lock-free single-producer/single-consumer ring buffer. Capacity is rounded up to a power of two.
+template <typename T>
+class RingBuffer
+{
+public:
+  RingBuffer(std::size_t capacity) : data(roundUp(capacity)), mask(data.size() - 1) {}
+
+  // producer side, returns the number of elements actually written
+  auto push(const T *src, std::size_t size) -> std::size_t
+  {
+    const auto w = writePos.load(std::memory_order_relaxed);
+    const auto r = readPos.load(std::memory_order_acquire);
+    size = std::min(size, data.size() - (w - r));
+    const auto idx = w & mask;
+    const auto first = std::min(size, data.size() - idx);
+    std::copy(src, src + first, data.data() + idx);
+    std::copy(src + first, src + size, data.data());
+    writePos.store(w + size, std::memory_order_release);
+    return size;
+  }
+
+  // consumer side, returns the number of elements actually read
+  auto pop(T *dst, std::size_t size) -> std::size_t
+  {
+    const auto r = readPos.load(std::memory_order_relaxed);
+    const auto w = writePos.load(std::memory_order_acquire);
+    size = std::min(size, w - r);
+    const auto idx = r & mask;
+    const auto first = std::min(size, data.size() - idx);
+    std::copy(data.data() + idx, data.data() + idx + first, dst);
+    std::copy(data.data(), data.data() + size - first, dst + first);
+    readPos.store(r + size, std::memory_order_release);
+    return size;
+  }
+
+  auto size() const -> std::size_t
+  {
+    return writePos.load(std::memory_order_acquire) - readPos.load(std::memory_order_acquire);
+  }
+
+  auto capacity() const -> std::size_t { return data.size(); }
+
+private:
+  static auto roundUp(std::size_t v) -> std::size_t
+  {
+    std::size_t r = 1;
+    while (r < v)
+      r <<= 1;
+    return r;
+  }
+
+  std::vector<T> data;
+  std::size_t mask;
+  alignas(64) std::atomic<std::size_t> writePos{0};
+  alignas(64) std::atomic<std::size_t> readPos{0};
+};
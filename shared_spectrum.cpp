@@ -0,0 +1,196 @@
+#include "shared_spectrum.hpp"
+#include "consts.hpp"
+#include <chrono>
+#include <cstring>
+#include <fcntl.h>
+#include <log/log.hpp>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static auto alignUp(uint64_t size) -> uint64_t
+{
+  return (size + 63) / 64 * 64;
+}
+
+SharedSpectrumWriter::SharedSpectrumWriter(const std::string &name,
+                                           int lanesNum,
+                                           const std::vector<std::vector<float>> &freqs,
+                                           int sampleFreq,
+                                           int slotsNum)
+  : name(name)
+{
+  if (freqs.size() > Shm::MaxTransforms)
+  {
+    LOG("Too many transforms for the shared memory", freqs.size());
+    throw -25;
+  }
+  Shm::Header h{};
+  h.magic = Shm::Magic;
+  h.version = Shm::Version;
+  h.lanesNum = lanesNum;
+  h.slotsNum = slotsNum;
+  h.keysNum = PianoKeys;
+  h.transformsNum = freqs.size();
+  h.sampleFreq = sampleFreq;
+  auto offset = alignUp(sizeof(Shm::Header));
+  for (auto t = 0U; t < freqs.size(); ++t)
+  {
+    h.binsNum[t] = freqs[t].size();
+    h.maxBins = std::max<uint32_t>(h.maxBins, freqs[t].size());
+    h.freqsOffset[t] = offset;
+    offset = alignUp(offset + freqs[t].size() * sizeof(float));
+  }
+  h.countersOffset = offset;
+  h.slotsOffset = alignUp(offset + lanesNum * sizeof(Shm::Counter));
+  h.slotSize = alignUp(sizeof(Shm::Slot) + (h.maxBins + h.keysNum) * sizeof(float));
+  h.size = h.slotsOffset + h.slotSize * slotsNum * lanesNum;
+
+  // An older segment of the name, left over by a crashed producer or still in use by another one,
+  // only loses its name: its readers keep the old object mapped and see it closed when its producer
+  // goes away
+  if (shm_unlink(name.c_str()) == 0)
+    LOG("Replacing the shared memory", name);
+  const auto fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+  if (fd < 0)
+  {
+    LOG("Could not create the shared memory", name, strerror(errno));
+    throw -25;
+  }
+  struct stat st;
+  if (fstat(fd, &st) == 0)
+    inode = st.st_ino;
+  if (ftruncate(fd, h.size) != 0)
+  {
+    LOG("Could not size the shared memory", name, h.size, strerror(errno));
+    close(fd);
+    shm_unlink(name.c_str());
+    throw -25;
+  }
+  data = mmap(nullptr, h.size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED)
+  {
+    LOG("Could not map the shared memory", name, strerror(errno));
+    shm_unlink(name.c_str());
+    throw -25;
+  }
+  // the new pages are zero: no frames, all the slots empty; the magic goes in last
+  header = static_cast<Shm::Header *>(data);
+  auto *bytes = static_cast<char *>(data);
+  for (auto t = 0U; t < freqs.size(); ++t)
+    memcpy(bytes + h.freqsOffset[t], freqs[t].data(), freqs[t].size() * sizeof(float));
+  const auto magic = h.magic;
+  h.magic = 0;
+  memcpy(static_cast<void *>(header), &h, sizeof(h));
+  std::atomic_thread_fence(std::memory_order_release);
+  reinterpret_cast<std::atomic<uint32_t> *>(&header->magic)->store(magic, std::memory_order_release);
+  LOG("Publishing the spectra to the shared memory", name, h.size, "bytes");
+}
+
+SharedSpectrumWriter::~SharedSpectrumWriter()
+{
+  header->isClosed.store(1, std::memory_order_release);
+  munmap(data, header->size);
+  // the name may belong to a newer producer by now
+  const auto fd = shm_open(name.c_str(), O_RDONLY, 0);
+  if (fd < 0)
+    return;
+  struct stat st;
+  const auto isOurs = fstat(fd, &st) == 0 && st.st_ino == inode;
+  close(fd);
+  if (isOurs)
+    shm_unlink(name.c_str());
+}
+
+auto SharedSpectrumWriter::slot(int lane, uint64_t frame) -> Shm::Slot *
+{
+  return reinterpret_cast<Shm::Slot *>(static_cast<char *>(data) + header->slotsOffset +
+                                       (lane * header->slotsNum + frame % header->slotsNum) * header->slotSize);
+}
+
+auto SharedSpectrumWriter::publish(
+  int lane, double time, int transform, const float *spectr, int binsNum, const float *notes) -> void
+{
+  auto &counter = reinterpret_cast<Shm::Counter *>(static_cast<char *>(data) + header->countersOffset)[lane];
+  const auto frame = counter.framesNum.load(std::memory_order_relaxed);
+  auto *s = slot(lane, frame);
+  s->seq.store(2 * frame + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  s->frame = frame;
+  s->time = time;
+  s->monotonicNs = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                     std::chrono::steady_clock::now().time_since_epoch())
+                     .count();
+  s->realtimeNs = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::system_clock::now().time_since_epoch())
+                    .count();
+  s->transform = transform;
+  s->binsNum = std::min<uint32_t>(binsNum, header->maxBins);
+  auto *values = reinterpret_cast<float *>(s + 1);
+  memcpy(values, spectr, s->binsNum * sizeof(float));
+  memcpy(values + header->maxBins, notes, header->keysNum * sizeof(float));
+  s->seq.store(2 * frame + 2, std::memory_order_release);
+  counter.framesNum.store(frame + 1, std::memory_order_release);
+}
+
+SharedSpectrumReader::SharedSpectrumReader(const std::string &name)
+{
+  const auto fd = shm_open(name.c_str(), O_RDONLY, 0);
+  if (fd < 0)
+  {
+    LOG("Could not open the shared memory", name, strerror(errno));
+    throw -26;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || static_cast<std::size_t>(st.st_size) < sizeof(Shm::Header))
+  {
+    LOG("The shared memory", name, "is not ready");
+    close(fd);
+    throw -26;
+  }
+  size = st.st_size;
+  data = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED)
+  {
+    LOG("Could not map the shared memory", name, strerror(errno));
+    throw -26;
+  }
+  hdr = static_cast<const Shm::Header *>(data);
+  const auto magic = reinterpret_cast<const std::atomic<uint32_t> *>(&hdr->magic)->load(std::memory_order_acquire);
+  if (magic != Shm::Magic || hdr->version != Shm::Version || hdr->size > size)
+  {
+    LOG("The shared memory", name, "has no spectra of version", Shm::Version);
+    munmap(const_cast<void *>(data), size);
+    throw -26;
+  }
+}
+
+SharedSpectrumReader::~SharedSpectrumReader()
+{
+  munmap(const_cast<void *>(data), size);
+}
+
+auto SharedSpectrumReader::freqs(int transform) const -> const float *
+{
+  return reinterpret_cast<const float *>(static_cast<const char *>(data) + hdr->freqsOffset[transform]);
+}
+
+auto SharedSpectrumReader::framesNum(int lane) const -> uint64_t
+{
+  const auto *counters =
+    reinterpret_cast<const Shm::Counter *>(static_cast<const char *>(data) + hdr->countersOffset);
+  return counters[lane].framesNum.load(std::memory_order_acquire);
+}
+
+auto SharedSpectrumReader::isClosed() const -> bool
+{
+  return hdr->isClosed.load(std::memory_order_acquire) != 0;
+}
+
+auto SharedSpectrumReader::slot(int lane, uint64_t frame) const -> const Shm::Slot *
+{
+  return reinterpret_cast<const Shm::Slot *>(static_cast<const char *>(data) + hdr->slotsOffset +
+                                             (lane * hdr->slotsNum + frame % hdr->slotsNum) * hdr->slotSize);
+}
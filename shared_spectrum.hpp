@@ -0,0 +1,146 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Layout of the shared memory segment the spectra are published to. The header is followed by the
+// frequency tables of the transforms, the frame counters of the lanes and then slotsNum slots per
+// lane. A slot is a seqlock: its seq is odd while the writer fills it and 2 * frame + 2 once frame
+// is complete, so a reader checks seq before and after it looks at the slot.
+namespace Shm
+{
+  const auto Magic = 0x48535053u; // "SPSH"
+  const auto Version = 1u;
+  const auto MaxTransforms = 8;
+
+  struct Header
+  {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t lanesNum;
+    uint32_t slotsNum;
+    // capacity of the spectrum of a slot, the largest transform
+    uint32_t maxBins;
+    uint32_t keysNum;
+    uint32_t transformsNum;
+    int32_t sampleFreq;
+    uint32_t binsNum[MaxTransforms];
+    // offsets from the segment start, the slots of lane l start at slotsOffset + l * slotsNum *
+    // slotSize
+    uint64_t freqsOffset[MaxTransforms];
+    uint64_t countersOffset;
+    uint64_t slotsOffset;
+    uint64_t slotSize;
+    uint64_t size;
+    // set when the producer goes away, a new segment of the same name may follow
+    std::atomic<uint32_t> isClosed;
+  };
+
+  // frames published by a lane, one per cache line
+  struct alignas(64) Counter
+  {
+    std::atomic<uint64_t> framesNum;
+  };
+
+  // followed by maxBins floats of the weighted spectrum and keysNum note confidences
+  struct alignas(64) Slot
+  {
+    std::atomic<uint64_t> seq;
+    uint64_t frame;
+    // seconds of audio analyzed, steady_clock (CLOCK_MONOTONIC) and system_clock of the publication
+    double time;
+    int64_t monotonicNs;
+    int64_t realtimeNs;
+    uint32_t transform;
+    uint32_t binsNum;
+  };
+} // namespace Shm
+
+// a published frame in place in the segment, valid until the slot is reused
+struct SharedFrame
+{
+  uint64_t frame;
+  double time;
+  int64_t monotonicNs;
+  int64_t realtimeNs;
+  int transform;
+  int binsNum;
+  const float *spectr;
+  const float *notes;
+};
+
+// The producer side: creates the segment in /dev/shm, taking the name over from an older one, and
+// unlinks it when destroyed. The lanes publish independently, each one from one thread at a time.
+class SharedSpectrumWriter
+{
+public:
+  // freqs of every transform by its index
+  SharedSpectrumWriter(const std::string &name,
+                       int lanesNum,
+                       const std::vector<std::vector<float>> &freqs,
+                       int sampleFreq,
+                       int slotsNum = 16);
+  ~SharedSpectrumWriter();
+  SharedSpectrumWriter(const SharedSpectrumWriter &) = delete;
+  SharedSpectrumWriter &operator=(const SharedSpectrumWriter &) = delete;
+  // notes are the Shm::Header::keysNum confidences
+  auto publish(int lane, double time, int transform, const float *spectr, int binsNum, const float *notes) -> void;
+
+private:
+  auto slot(int lane, uint64_t frame) -> Shm::Slot *;
+
+  std::string name;
+  // of the segment created, the name is only unlinked while it still refers to it
+  uint64_t inode = 0;
+  void *data;
+  Shm::Header *header;
+};
+
+// The consumer side: maps the segment read-only, nothing but memory reads per frame.
+class SharedSpectrumReader
+{
+public:
+  SharedSpectrumReader(const std::string &name);
+  ~SharedSpectrumReader();
+  SharedSpectrumReader(const SharedSpectrumReader &) = delete;
+  SharedSpectrumReader &operator=(const SharedSpectrumReader &) = delete;
+  auto header() const -> const Shm::Header & { return *hdr; }
+  auto freqs(int transform) const -> const float *;
+  // frames the lane published so far, the latest is framesNum() - 1
+  auto framesNum(int lane) const -> uint64_t;
+  // the producer is gone, reopen to follow the next one
+  auto isClosed() const -> bool;
+  // Calls f(const SharedFrame &) on the frame in place and returns whether the frame was intact
+  // all along. False if the frame is not there yet or its slot was reused, and then whatever f
+  // made of it has to be thrown away.
+  template <typename F>
+  auto read(int lane, uint64_t frame, F &&f) const -> bool
+  {
+    const auto *s = slot(lane, frame);
+    const auto seq = s->seq.load(std::memory_order_acquire);
+    if (seq != 2 * frame + 2)
+      return false;
+    // a torn slot still has to keep f inside the segment
+    const auto *spectr = reinterpret_cast<const float *>(s + 1);
+    f(SharedFrame{s->frame,
+                  s->time,
+                  s->monotonicNs,
+                  s->realtimeNs,
+                  static_cast<int>(std::min(s->transform, hdr->transformsNum - 1)),
+                  static_cast<int>(std::min(s->binsNum, hdr->maxBins)),
+                  spectr,
+                  spectr + hdr->maxBins});
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return s->seq.load(std::memory_order_relaxed) == seq;
+  }
+
+private:
+  auto slot(int lane, uint64_t frame) const -> const Shm::Slot *;
+
+  const void *data;
+  std::size_t size;
+  const Shm::Header *hdr;
+};
@@ -0,0 +1,298 @@
+#include "shm_tool.hpp"
+#include "analyzer.hpp"
+#include "consts.hpp"
+#include "pitch_tracker.hpp"
+#include "shared_spectrum.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <iterator>
+#include <log/log.hpp>
+#include <memory>
+#include <string>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace
+{
+  auto monotonicNs() -> int64_t
+  {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+  }
+
+  // the pattern of the test frames, every value depends on the lane, the frame and the bin
+  const int TestBins[] = {16384, 509};
+
+  auto testTransform(int lane, uint64_t frame) -> int
+  {
+    return (frame + lane) % std::size(TestBins);
+  }
+
+  auto testValue(int lane, uint64_t frame, int k) -> float
+  {
+    // exact in a float for the frame counts of the test
+    return (frame % 4096) * 4096.f + k + lane;
+  }
+
+  struct Stats
+  {
+    uint64_t intact = 0;
+    // never looked at because the reader fell behind
+    uint64_t skipped = 0;
+    // rejected by the seqlock, the slot was reused while the reader looked at it
+    uint64_t torn = 0;
+    uint64_t corrupt = 0;
+    double latencyUs = 0;
+    double maxLatencyUs = 0;
+  };
+
+  // follows all the lanes until every one of them published frames frames, returns the exit code
+  auto testReader(const std::string &name, int idx, uint64_t frames) -> int
+  {
+    SharedSpectrumReader reader(name);
+    const auto &h = reader.header();
+    Stats stats;
+    std::vector<uint64_t> next(h.lanesNum);
+    for (;;)
+    {
+      auto isDone = true;
+      auto isIdle = true;
+      for (auto lane = 0U; lane < h.lanesNum; ++lane)
+      {
+        if (next[lane] >= frames)
+          continue;
+        isDone = false;
+        const auto published = reader.framesNum(lane);
+        if (next[lane] >= published)
+          continue;
+        isIdle = false;
+        // the oldest slots are about to be reused, the latest frame is all that is left to read
+        if (published - next[lane] > h.slotsNum / 2)
+        {
+          stats.skipped += published - 1 - next[lane];
+          next[lane] = published - 1;
+        }
+        const auto frame = next[lane]++;
+        auto isValid = true;
+        auto latencyUs = 0.;
+        const auto isIntact = reader.read(lane, frame, [&](const SharedFrame &f) {
+          latencyUs = (monotonicNs() - f.monotonicNs) / 1000.;
+          const auto transform = testTransform(lane, frame);
+          isValid = f.frame == frame && f.transform == transform && f.binsNum == TestBins[transform] &&
+                    f.time == frame * 0.01;
+          for (auto k = 0; isValid && k < f.binsNum; ++k)
+            isValid = f.spectr[k] == testValue(lane, frame, k);
+          for (auto k = 0U; isValid && k < h.keysNum; ++k)
+            isValid = f.notes[k] == testValue(lane, frame, k);
+        });
+        if (!isIntact)
+          ++stats.torn;
+        else if (!isValid)
+          ++stats.corrupt;
+        else
+        {
+          ++stats.intact;
+          stats.latencyUs += latencyUs;
+          stats.maxLatencyUs = std::max(stats.maxLatencyUs, latencyUs);
+        }
+      }
+      if (isDone || (isIdle && reader.isClosed()))
+        break;
+      if (isIdle)
+        std::this_thread::yield();
+    }
+    printf("reader %d: %llu intact, %llu skipped, %llu torn, %llu corrupt, latency %.1f us mean, %.1f us max\n",
+           idx,
+           static_cast<unsigned long long>(stats.intact),
+           static_cast<unsigned long long>(stats.skipped),
+           static_cast<unsigned long long>(stats.torn),
+           static_cast<unsigned long long>(stats.corrupt),
+           stats.intact > 0 ? stats.latencyUs / stats.intact : 0.,
+           stats.maxLatencyUs);
+    return stats.corrupt == 0 && stats.intact > 0 ? 0 : 1;
+  }
+} // namespace
+
+auto readShmUsage() -> const char *
+{
+  return "<name> [--lane <n>] [--frames <n>]";
+}
+
+auto readShm(int argc, const char *argv[]) -> int
+{
+  if (argc < 3)
+  {
+    LOG("Usage:", argv[0], "--read-shm", readShmUsage());
+    return 1;
+  }
+  const std::string name = argv[2];
+  auto lane = 0U;
+  auto frames = uint64_t{0};
+  for (auto i = 3; i + 1 < argc; i += 2)
+    if (strcmp(argv[i], "--lane") == 0)
+      lane = std::stoi(argv[i + 1]);
+    else if (strcmp(argv[i], "--frames") == 0)
+      frames = std::stoll(argv[i + 1]);
+  SharedSpectrumReader reader(name);
+  const auto &h = reader.header();
+  if (lane >= h.lanesNum)
+  {
+    LOG("No lane", lane, "of", h.lanesNum);
+    return 1;
+  }
+  printf("%s: %d lanes, %d slots, %d Hz\n", name.c_str(), h.lanesNum, h.slotsNum, h.sampleFreq);
+  auto next = reader.framesNum(lane);
+  auto missed = uint64_t{0};
+  for (auto printed = uint64_t{0}; frames == 0 || printed < frames;)
+  {
+    const auto published = reader.framesNum(lane);
+    if (next >= published)
+    {
+      if (reader.isClosed())
+      {
+        printf("the producer is gone\n");
+        break;
+      }
+      // a frame every hop, a millisecond of polling costs nothing next to that
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      continue;
+    }
+    // only the latest frame is of interest to a display
+    missed += published - 1 - next;
+    const auto frame = published - 1;
+    next = published;
+    SharedFrame copy{};
+    auto peak = 0;
+    std::string notes;
+    const auto isIntact = reader.read(lane, frame, [&](const SharedFrame &f) {
+      copy = f;
+      peak = std::max_element(f.spectr, f.spectr + f.binsNum) - f.spectr;
+      notes.clear();
+      for (auto k = 0U; k < h.keysNum; ++k)
+        if (f.notes[k] > 0)
+          notes += " " + noteName(k);
+    });
+    if (!isIntact)
+    {
+      ++missed;
+      continue;
+    }
+    const auto level = copy.binsNum > 0 ? copy.spectr[peak] : 0.f;
+    printf("%llu %.3f s %.1f us %s %.1f Hz %.1f dB%s\n",
+           static_cast<unsigned long long>(copy.frame),
+           copy.time,
+           (monotonicNs() - copy.monotonicNs) / 1000.,
+           toString(static_cast<Transform>(copy.transform)),
+           copy.binsNum > 0 ? reader.freqs(copy.transform)[peak] : 0.f,
+           20 * log10f(std::max(level, 1e-10f)),
+           notes.c_str());
+    fflush(stdout);
+    ++printed;
+  }
+  printf("%llu frames skipped\n", static_cast<unsigned long long>(missed));
+  return 0;
+}
+
+auto shmTestUsage() -> const char *
+{
+  return "[--readers <n>] [--lanes <n>] [--frames <n>] [--rate <frames per second>]";
+}
+
+auto shmTest(int argc, const char *argv[]) -> int
+{
+  auto readersNum = 4;
+  auto lanesNum = 2;
+  auto frames = uint64_t{10000};
+  // frames per second of every lane, 0 for as fast as possible; the live analysis runs at about 47
+  auto rate = 2000;
+  for (auto i = 2; i + 1 < argc; i += 2)
+    if (strcmp(argv[i], "--readers") == 0)
+      readersNum = std::stoi(argv[i + 1]);
+    else if (strcmp(argv[i], "--lanes") == 0)
+      lanesNum = std::stoi(argv[i + 1]);
+    else if (strcmp(argv[i], "--frames") == 0)
+      frames = std::stoll(argv[i + 1]);
+    else if (strcmp(argv[i], "--rate") == 0)
+      rate = std::stoi(argv[i + 1]);
+  const auto name = "/spectrogram-test-" + std::to_string(getpid());
+  std::vector<std::vector<float>> freqs;
+  for (const auto size : TestBins)
+  {
+    freqs.emplace_back();
+    for (auto k = 0; k < size; ++k)
+      freqs.back().push_back(k);
+  }
+  SharedSpectrumWriter writer(name, lanesNum, freqs, 48000);
+
+  fflush(stdout);
+  std::vector<pid_t> readers;
+  for (auto i = 0; i < readersNum; ++i)
+  {
+    const auto pid = fork();
+    if (pid < 0)
+    {
+      LOG("Could not start reader", i, strerror(errno));
+      break;
+    }
+    if (pid == 0)
+    {
+      // the writer belongs to the parent, the reader leaves without any destructor
+      auto res = 1;
+      try
+      {
+        res = testReader(name, i, frames);
+      }
+      catch (int)
+      {
+      }
+      fflush(stdout);
+      _exit(res);
+    }
+    readers.push_back(pid);
+  }
+
+  // the readers start from the first frame, give them the time to map the segment
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  std::vector<float> spectr(*std::max_element(std::begin(TestBins), std::end(TestBins)));
+  std::vector<float> notes(PianoKeys);
+  const auto t1 = std::chrono::steady_clock::now();
+  auto publishUs = 0.;
+  for (auto frame = uint64_t{0}; frame < frames; ++frame)
+  {
+    if (rate > 0)
+      std::this_thread::sleep_until(t1 + std::chrono::microseconds(frame * 1'000'000 / rate));
+    for (auto lane = 0; lane < lanesNum; ++lane)
+    {
+      const auto transform = testTransform(lane, frame);
+      for (auto k = 0; k < TestBins[transform]; ++k)
+        spectr[k] = testValue(lane, frame, k);
+      for (auto k = 0; k < PianoKeys; ++k)
+        notes[k] = testValue(lane, frame, k);
+      const auto t2 = std::chrono::steady_clock::now();
+      writer.publish(lane, frame * 0.01, transform, spectr.data(), TestBins[transform], notes.data());
+      publishUs += std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - t2).count();
+    }
+  }
+
+  auto res = readers.size() == static_cast<std::size_t>(readersNum) ? 0 : 1;
+  for (const auto pid : readers)
+  {
+    auto status = 0;
+    if (waitpid(pid, &status, 0) != pid || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+      res = 1;
+  }
+  printf("published %llu frames on %d lanes to %d readers in %.0f ms, %.2f us per frame: %s\n",
+         static_cast<unsigned long long>(frames),
+         lanesNum,
+         readersNum,
+         std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t1).count(),
+         publishUs / (frames * lanesNum),
+         res == 0 ? "ok" : "FAILED");
+  return res;
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+// Reference consumer of the frames the analyzer publishes with the shm option, prints the loudest
+// bin and the sounding notes of every frame of a lane:
+// spectrogram --read-shm <name> [--lane <n>] [--frames <n>]
+auto readShm(int argc, const char *argv[]) -> int;
+// the arguments after --read-shm
+auto readShmUsage() -> const char *;
+
+// One producer publishing patterned frames and several reader processes checking every frame they
+// accept, fails if any of them accepted a torn frame; --rate 0 publishes as fast as possible:
+// spectrogram --shm-test [--readers <n>] [--lanes <n>] [--frames <n>] [--rate <frames per second>]
+auto shmTest(int argc, const char *argv[]) -> int;
+// the arguments after --shm-test
+auto shmTestUsage() -> const char *;
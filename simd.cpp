@@ -0,0 +1,469 @@
+#include "simd.hpp"
+#include <algorithm>
+#include <cmath>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SIMD_X86 1
+#include <immintrin.h>
+#endif
+
+namespace
+{
+  auto windowScalar(const int16_t *src, const float *win, float *__restrict dst, int size) -> void
+  {
+    for (auto i = 0; i < size; ++i)
+      dst[i] = win[i] * src[i];
+  }
+
+  auto magnitudeScalar(const float *b, const float *gain, float *__restrict out, int begin, int size)
+    -> void
+  {
+    for (auto i = begin; i < size; ++i)
+      out[i] = gain[i] * sqrtf(b[2 * i] * b[2 * i] + b[2 * i + 1] * b[2 * i + 1]);
+  }
+
+  auto powerScalar(const float *b, float *__restrict out, int begin, int size) -> void
+  {
+    for (auto i = begin; i < size; ++i)
+      out[i] = b[2 * i] * b[2 * i] + b[2 * i + 1] * b[2 * i + 1];
+  }
+
+  auto scaleScalar(const float *a, float k, float *out, int begin, int size) -> void
+  {
+    for (auto i = begin; i < size; ++i)
+      out[i] = a[i] * k;
+  }
+
+  auto divideScalar(const float *a, const float *b, float k, float *out, int begin, int size) -> void
+  {
+    for (auto i = begin; i < size; ++i)
+      out[i] = a[i] / b[i] * k;
+  }
+
+  auto addScaledScalar(const float *a, float k, float *out, int begin, int size) -> void
+  {
+    for (auto i = begin; i < size; ++i)
+      out[i] += a[i] * k;
+  }
+
+  auto subtractProductScalar(const float *a, const float *b, float *out, int begin, int size) -> void
+  {
+    for (auto i = begin; i < size; ++i)
+      out[i] -= a[i] * b[i];
+  }
+
+  auto maxRatioScalar(const float *a, const float *b, float max, int begin, int size) -> float
+  {
+    for (auto i = begin; i < size; ++i)
+      max = std::max(max, a[i] / b[i]);
+    return max;
+  }
+
+  auto trackMinimumScalar(const float *x,
+                          float k,
+                          float rise,
+                          float minFloor,
+                          float *__restrict level,
+                          float *__restrict floor,
+                          int begin,
+                          int size) -> void
+  {
+    for (auto i = begin; i < size; ++i)
+    {
+      level[i] += k * (x[i] - level[i]);
+      floor[i] = std::max(std::min(level[i], floor[i] * rise), minFloor);
+    }
+  }
+
+#ifdef SIMD_X86
+  __attribute__((target("sse2"))) auto windowSse2(const int16_t *src, const float *win, float *dst, int size)
+    -> void
+  {
+    auto i = 0;
+    for (; i + 8 <= size; i += 8)
+    {
+      const auto s = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+      // sign extend by unpacking into the upper halves and shifting back
+      const auto lo = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(s, s), 16));
+      const auto hi = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(s, s), 16));
+      _mm_storeu_ps(dst + i, _mm_mul_ps(lo, _mm_loadu_ps(win + i)));
+      _mm_storeu_ps(dst + i + 4, _mm_mul_ps(hi, _mm_loadu_ps(win + i + 4)));
+    }
+    windowScalar(src + i, win + i, dst + i, size - i);
+  }
+
+  __attribute__((target("sse2"))) auto squaresSse2(const float *b) -> __m128
+  {
+    const auto x = _mm_loadu_ps(b);
+    const auto y = _mm_loadu_ps(b + 4);
+    const auto re = _mm_shuffle_ps(x, y, _MM_SHUFFLE(2, 0, 2, 0));
+    const auto im = _mm_shuffle_ps(x, y, _MM_SHUFFLE(3, 1, 3, 1));
+    return _mm_add_ps(_mm_mul_ps(re, re), _mm_mul_ps(im, im));
+  }
+
+  __attribute__((target("sse2"))) auto magnitudeSse2(const float *b, const float *gain, float *out, int size)
+    -> void
+  {
+    auto i = 0;
+    for (; i + 4 <= size; i += 4)
+      _mm_storeu_ps(out + i, _mm_mul_ps(_mm_loadu_ps(gain + i), _mm_sqrt_ps(squaresSse2(b + 2 * i))));
+    magnitudeScalar(b, gain, out, i, size);
+  }
+
+  __attribute__((target("sse2"))) auto powerSse2(const float *b, float *out, int size) -> void
+  {
+    auto i = 0;
+    for (; i + 4 <= size; i += 4)
+      _mm_storeu_ps(out + i, squaresSse2(b + 2 * i));
+    powerScalar(b, out, i, size);
+  }
+
+  __attribute__((target("sse2"))) auto scaleSse2(const float *a, float k, float *out, int size) -> void
+  {
+    const auto kk = _mm_set1_ps(k);
+    auto i = 0;
+    for (; i + 4 <= size; i += 4)
+      _mm_storeu_ps(out + i, _mm_mul_ps(_mm_loadu_ps(a + i), kk));
+    scaleScalar(a, k, out, i, size);
+  }
+
+  __attribute__((target("sse2"))) auto divideSse2(const float *a, const float *b, float k, float *out, int size)
+    -> void
+  {
+    const auto kk = _mm_set1_ps(k);
+    auto i = 0;
+    for (; i + 4 <= size; i += 4)
+      _mm_storeu_ps(out + i, _mm_mul_ps(_mm_div_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)), kk));
+    divideScalar(a, b, k, out, i, size);
+  }
+
+  __attribute__((target("sse2"))) auto addScaledSse2(const float *a, float k, float *out, int size) -> void
+  {
+    const auto kk = _mm_set1_ps(k);
+    auto i = 0;
+    for (; i + 4 <= size; i += 4)
+      _mm_storeu_ps(out + i, _mm_add_ps(_mm_loadu_ps(out + i), _mm_mul_ps(_mm_loadu_ps(a + i), kk)));
+    addScaledScalar(a, k, out, i, size);
+  }
+
+  __attribute__((target("sse2"))) auto subtractProductSse2(const float *a,
+                                                           const float *b,
+                                                           float *out,
+                                                           int size) -> void
+  {
+    auto i = 0;
+    for (; i + 4 <= size; i += 4)
+      _mm_storeu_ps(out + i,
+                    _mm_sub_ps(_mm_loadu_ps(out + i), _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i))));
+    subtractProductScalar(a, b, out, i, size);
+  }
+
+  __attribute__((target("sse2"))) auto maxRatioSse2(const float *a, const float *b, int size) -> float
+  {
+    auto max = _mm_setzero_ps();
+    auto i = 0;
+    for (; i + 4 <= size; i += 4)
+      max = _mm_max_ps(_mm_div_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)), max);
+    float lanes[4];
+    _mm_storeu_ps(lanes, max);
+    return maxRatioScalar(a, b, std::max(std::max(lanes[0], lanes[1]), std::max(lanes[2], lanes[3])), i, size);
+  }
+
+  __attribute__((target("sse2"))) auto trackMinimumSse2(const float *x,
+                                                        float k,
+                                                        float rise,
+                                                        float minFloor,
+                                                        float *level,
+                                                        float *floor,
+                                                        int size) -> void
+  {
+    const auto kk = _mm_set1_ps(k);
+    const auto rr = _mm_set1_ps(rise);
+    const auto mm = _mm_set1_ps(minFloor);
+    auto i = 0;
+    for (; i + 4 <= size; i += 4)
+    {
+      auto l = _mm_loadu_ps(level + i);
+      l = _mm_add_ps(l, _mm_mul_ps(kk, _mm_sub_ps(_mm_loadu_ps(x + i), l)));
+      _mm_storeu_ps(level + i, l);
+      _mm_storeu_ps(floor + i, _mm_max_ps(_mm_min_ps(l, _mm_mul_ps(_mm_loadu_ps(floor + i), rr)), mm));
+    }
+    trackMinimumScalar(x, k, rise, minFloor, level, floor, i, size);
+  }
+
+  __attribute__((target("avx2"))) auto windowAvx2(const int16_t *src, const float *win, float *dst, int size)
+    -> void
+  {
+    auto i = 0;
+    for (; i + 8 <= size; i += 8)
+    {
+      const auto s = _mm256_cvtepi16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i)));
+      _mm256_storeu_ps(dst + i, _mm256_mul_ps(_mm256_cvtepi32_ps(s), _mm256_loadu_ps(win + i)));
+    }
+    windowScalar(src + i, win + i, dst + i, size - i);
+  }
+
+  __attribute__((target("avx2,fma"))) auto squaresAvx2(const float *b) -> __m256
+  {
+    // x = [c0 c1 | c2 c3], y = [c4 c5 | c6 c7]
+    const auto x = _mm256_loadu_ps(b);
+    const auto y = _mm256_loadu_ps(b + 8);
+    const auto re = _mm256_shuffle_ps(x, y, _MM_SHUFFLE(2, 0, 2, 0));
+    const auto im = _mm256_shuffle_ps(x, y, _MM_SHUFFLE(3, 1, 3, 1));
+    // [0 1 4 5 | 2 3 6 7] -> [0 1 2 3 | 4 5 6 7]
+    const auto sq = _mm256_fmadd_ps(re, re, _mm256_mul_ps(im, im));
+    return _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(sq), _MM_SHUFFLE(3, 1, 2, 0)));
+  }
+
+  __attribute__((target("avx2,fma"))) auto magnitudeAvx2(const float *b,
+                                                         const float *gain,
+                                                         float *out,
+                                                         int size) -> void
+  {
+    auto i = 0;
+    for (; i + 8 <= size; i += 8)
+      _mm256_storeu_ps(out + i,
+                       _mm256_mul_ps(_mm256_loadu_ps(gain + i), _mm256_sqrt_ps(squaresAvx2(b + 2 * i))));
+    magnitudeScalar(b, gain, out, i, size);
+  }
+
+  __attribute__((target("avx2,fma"))) auto powerAvx2(const float *b, float *out, int size) -> void
+  {
+    auto i = 0;
+    for (; i + 8 <= size; i += 8)
+      _mm256_storeu_ps(out + i, squaresAvx2(b + 2 * i));
+    powerScalar(b, out, i, size);
+  }
+
+  __attribute__((target("avx2"))) auto scaleAvx2(const float *a, float k, float *out, int size) -> void
+  {
+    const auto kk = _mm256_set1_ps(k);
+    auto i = 0;
+    for (; i + 8 <= size; i += 8)
+      _mm256_storeu_ps(out + i, _mm256_mul_ps(_mm256_loadu_ps(a + i), kk));
+    scaleScalar(a, k, out, i, size);
+  }
+
+  __attribute__((target("avx2"))) auto divideAvx2(const float *a, const float *b, float k, float *out, int size)
+    -> void
+  {
+    const auto kk = _mm256_set1_ps(k);
+    auto i = 0;
+    for (; i + 8 <= size; i += 8)
+      _mm256_storeu_ps(out + i, _mm256_mul_ps(_mm256_div_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i)), kk));
+    divideScalar(a, b, k, out, i, size);
+  }
+
+  __attribute__((target("avx2,fma"))) auto addScaledAvx2(const float *a, float k, float *out, int size) -> void
+  {
+    const auto kk = _mm256_set1_ps(k);
+    auto i = 0;
+    for (; i + 8 <= size; i += 8)
+      _mm256_storeu_ps(out + i, _mm256_fmadd_ps(_mm256_loadu_ps(a + i), kk, _mm256_loadu_ps(out + i)));
+    addScaledScalar(a, k, out, i, size);
+  }
+
+  __attribute__((target("avx2,fma"))) auto subtractProductAvx2(const float *a,
+                                                               const float *b,
+                                                               float *out,
+                                                               int size) -> void
+  {
+    auto i = 0;
+    for (; i + 8 <= size; i += 8)
+      _mm256_storeu_ps(out + i,
+                       _mm256_fnmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), _mm256_loadu_ps(out + i)));
+    subtractProductScalar(a, b, out, i, size);
+  }
+
+  __attribute__((target("avx2"))) auto maxRatioAvx2(const float *a, const float *b, int size) -> float
+  {
+    auto max = _mm256_setzero_ps();
+    auto i = 0;
+    for (; i + 8 <= size; i += 8)
+      max = _mm256_max_ps(_mm256_div_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i)), max);
+    // fold the upper half onto the lower one
+    auto m4 = _mm_max_ps(_mm256_castps256_ps128(max), _mm256_extractf128_ps(max, 1));
+    m4 = _mm_max_ps(m4, _mm_movehl_ps(m4, m4));
+    m4 = _mm_max_ss(m4, _mm_shuffle_ps(m4, m4, _MM_SHUFFLE(1, 1, 1, 1)));
+    return maxRatioScalar(a, b, _mm_cvtss_f32(m4), i, size);
+  }
+
+  __attribute__((target("avx2,fma"))) auto trackMinimumAvx2(const float *x,
+                                                            float k,
+                                                            float rise,
+                                                            float minFloor,
+                                                            float *level,
+                                                            float *floor,
+                                                            int size) -> void
+  {
+    const auto kk = _mm256_set1_ps(k);
+    const auto rr = _mm256_set1_ps(rise);
+    const auto mm = _mm256_set1_ps(minFloor);
+    auto i = 0;
+    for (; i + 8 <= size; i += 8)
+    {
+      auto l = _mm256_loadu_ps(level + i);
+      l = _mm256_fmadd_ps(kk, _mm256_sub_ps(_mm256_loadu_ps(x + i), l), l);
+      _mm256_storeu_ps(level + i, l);
+      const auto risen = _mm256_mul_ps(_mm256_loadu_ps(floor + i), rr);
+      _mm256_storeu_ps(floor + i, _mm256_max_ps(_mm256_min_ps(l, risen), mm));
+    }
+    trackMinimumScalar(x, k, rise, minFloor, level, floor, i, size);
+  }
+#endif
+
+  auto bestIsa() -> Simd::Isa
+  {
+#ifdef SIMD_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+      return Simd::Isa::Avx2;
+    if (__builtin_cpu_supports("sse2"))
+      return Simd::Isa::Sse2;
+#endif
+    return Simd::Isa::Scalar;
+  }
+
+  Simd::Isa currentIsa = bestIsa();
+} // namespace
+
+namespace Simd
+{
+  auto isa() -> Isa
+  {
+    return currentIsa;
+  }
+
+  auto setIsa(Isa value) -> void
+  {
+    currentIsa = static_cast<int>(value) <= static_cast<int>(bestIsa()) ? value : bestIsa();
+  }
+
+  auto toString(Isa value) -> const char *
+  {
+    switch (value)
+    {
+    case Isa::Scalar: return "scalar";
+    case Isa::Sse2: return "sse2";
+    case Isa::Avx2: return "avx2";
+    }
+    return "unknown";
+  }
+
+  auto window(const int16_t *src, const float *win, float *dst, int size) -> void
+  {
+    switch (currentIsa)
+    {
+#ifdef SIMD_X86
+    case Isa::Avx2: return windowAvx2(src, win, dst, size);
+    case Isa::Sse2: return windowSse2(src, win, dst, size);
+#endif
+    default: return windowScalar(src, win, dst, size);
+    }
+  }
+
+  auto windowRing(const int16_t *ring, int size, int pos, const float *win, float *dst) -> void
+  {
+    window(ring + pos, win, dst, size - pos);
+    window(ring, win + size - pos, dst + size - pos, pos);
+  }
+
+  auto magnitude(const fftwf_complex *bins, const float *gain, float *out, int size) -> void
+  {
+    const auto b = reinterpret_cast<const float *>(bins);
+    switch (currentIsa)
+    {
+#ifdef SIMD_X86
+    case Isa::Avx2: return magnitudeAvx2(b, gain, out, size);
+    case Isa::Sse2: return magnitudeSse2(b, gain, out, size);
+#endif
+    default: return magnitudeScalar(b, gain, out, 0, size);
+    }
+  }
+
+  auto power(const fftwf_complex *bins, float *out, int size) -> void
+  {
+    const auto b = reinterpret_cast<const float *>(bins);
+    switch (currentIsa)
+    {
+#ifdef SIMD_X86
+    case Isa::Avx2: return powerAvx2(b, out, size);
+    case Isa::Sse2: return powerSse2(b, out, size);
+#endif
+    default: return powerScalar(b, out, 0, size);
+    }
+  }
+
+  auto scale(const float *a, float k, float *out, int size) -> void
+  {
+    switch (currentIsa)
+    {
+#ifdef SIMD_X86
+    case Isa::Avx2: return scaleAvx2(a, k, out, size);
+    case Isa::Sse2: return scaleSse2(a, k, out, size);
+#endif
+    default: return scaleScalar(a, k, out, 0, size);
+    }
+  }
+
+  auto divide(const float *a, const float *b, float k, float *out, int size) -> void
+  {
+    switch (currentIsa)
+    {
+#ifdef SIMD_X86
+    case Isa::Avx2: return divideAvx2(a, b, k, out, size);
+    case Isa::Sse2: return divideSse2(a, b, k, out, size);
+#endif
+    default: return divideScalar(a, b, k, out, 0, size);
+    }
+  }
+
+  auto addScaled(const float *a, float k, float *out, int size) -> void
+  {
+    switch (currentIsa)
+    {
+#ifdef SIMD_X86
+    case Isa::Avx2: return addScaledAvx2(a, k, out, size);
+    case Isa::Sse2: return addScaledSse2(a, k, out, size);
+#endif
+    default: return addScaledScalar(a, k, out, 0, size);
+    }
+  }
+
+  auto subtractProduct(const float *a, const float *b, float *out, int size) -> void
+  {
+    switch (currentIsa)
+    {
+#ifdef SIMD_X86
+    case Isa::Avx2: return subtractProductAvx2(a, b, out, size);
+    case Isa::Sse2: return subtractProductSse2(a, b, out, size);
+#endif
+    default: return subtractProductScalar(a, b, out, 0, size);
+    }
+  }
+
+  auto maxRatio(const float *a, const float *b, int size) -> float
+  {
+    switch (currentIsa)
+    {
+#ifdef SIMD_X86
+    case Isa::Avx2: return maxRatioAvx2(a, b, size);
+    case Isa::Sse2: return maxRatioSse2(a, b, size);
+#endif
+    default: return maxRatioScalar(a, b, 0.f, 0, size);
+    }
+  }
+
+  auto trackMinimum(const float *x, float k, float rise, float minFloor, float *level, float *floor, int size)
+    -> void
+  {
+    switch (currentIsa)
+    {
+#ifdef SIMD_X86
+    case Isa::Avx2: return trackMinimumAvx2(x, k, rise, minFloor, level, floor, size);
+    case Isa::Sse2: return trackMinimumSse2(x, k, rise, minFloor, level, floor, size);
+#endif
+    default: return trackMinimumScalar(x, k, rise, minFloor, level, floor, 0, size);
+    }
+  }
+} // namespace Simd
@@ -0,0 +1,38 @@
+#pragma once
+#include <cstdint>
+#include <fftw3.h>
+
+// Vectorized kernels of the capture pipeline. The implementation is picked at runtime from the
+// best instruction set the CPU supports.
+namespace Simd
+{
+  enum class Isa { Scalar, Sse2, Avx2 };
+
+  auto isa() -> Isa;
+  // forces an implementation, used by the benchmark; falls back to the best supported one
+  auto setIsa(Isa) -> void;
+  auto toString(Isa) -> const char *;
+
+  // dst[i] = win[i] * src[i]
+  auto window(const int16_t *src, const float *win, float *dst, int size) -> void;
+  // unwraps ring buffer of the given size starting from pos into dst and applies the window
+  auto windowRing(const int16_t *ring, int size, int pos, const float *win, float *dst) -> void;
+  // out[i] = gain[i] * |bins[i]|
+  auto magnitude(const fftwf_complex *bins, const float *gain, float *out, int size) -> void;
+  // out[i] = |bins[i]|^2
+  auto power(const fftwf_complex *bins, float *out, int size) -> void;
+  // out[i] = a[i] * k, out may be a
+  auto scale(const float *a, float k, float *out, int size) -> void;
+  // out[i] = a[i] / b[i] * k, out may be a
+  auto divide(const float *a, const float *b, float k, float *out, int size) -> void;
+  // out[i] += a[i] * k
+  auto addScaled(const float *a, float k, float *out, int size) -> void;
+  // out[i] -= a[i] * b[i]
+  auto subtractProduct(const float *a, const float *b, float *out, int size) -> void;
+  // the largest a[i] / b[i], 0 for an empty range
+  auto maxRatio(const float *a, const float *b, int size) -> float;
+  // level[i] follows x[i] with the smoothing factor k, floor[i] drops to the level at once and
+  // otherwise rises by the factor rise per call, but never below minFloor
+  auto trackMinimum(const float *x, float k, float rise, float minFloor, float *level, float *floor, int size)
+    -> void;
+} // namespace Simd
@@ -0,0 +1,304 @@
+#include "soft_rend.hpp"
+#include "config.hpp"
+#include "consts.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace
+{
+  // note colors of the shaders, C is 0
+  const float NoteColors[12][3] = {{0.5f, 1, 0},
+                                   {1, 0, 1},
+                                   {0, 1, 0.5f},
+                                   {1, 0, 0},
+                                   {0, 0.5f, 1},
+                                   {1, 1, 0},
+                                   {0.5f, 0, 1},
+                                   {0, 1, 0},
+                                   {1, 0, 0.5f},
+                                   {0, 1, 1},
+                                   {1, 0.5f, 0},
+                                   {0, 0, 1}};
+
+  // note color in rgb, the share of white in a
+  auto noteColor(float freq) -> SoftRend::Color
+  {
+    auto fNote = logf(freq / 55 * 2) / logf(2.f) * 12.f + .5f;
+    const auto note = static_cast<int>(fNote);
+    fNote = fabsf((fNote - note - .5f) * 2);
+    if (note < 0)
+      return {0, 0, 0, fNote};
+    const auto &c = NoteColors[note % 12];
+    return {c[0], c[1], c[2], fNote};
+  }
+
+  auto toByte(float value) -> uint8_t
+  {
+    return static_cast<uint8_t>(std::clamp(value, 0.f, 1.f) * 255.f + .5f);
+  }
+
+  auto shade(const SoftRend::Color &c, float v) -> SoftRend::Color
+  {
+    return {c.r * v * (1 - c.a) + v * c.a, c.g * v * (1 - c.a) + v * c.a, c.b * v * (1 - c.a) + v * c.a, v};
+  }
+} // namespace
+
+// same as the vertex shaders
+auto SoftRend::toX(float freq) const -> float
+{
+  return logf(freq / startFreq) / logf(endFreq / startFreq) * 2 - 1;
+}
+
+// pixel centers in normalized device coordinates, rows are counted from the bottom like gl_FragCoord
+auto SoftRend::columnX(int px) const -> float
+{
+  return (px + .5f) / width * 2 - 1;
+}
+
+auto SoftRend::rowY(int row) const -> float
+{
+  return (height - row - .5f) / height * 2 - 1;
+}
+
+// the lower keyboard and the spectrum shaders darken every N-th column
+auto SoftRend::isGridColumn(int px) const -> bool
+{
+  return px % (width / 12 / 5) == 0;
+}
+
+// linear interpolation of the values at the vertices over the screen columns, like the varyings of
+// a strip of quads; columns outside of the strip get nothing
+template <typename F>
+auto SoftRend::forEachColumn(const std::vector<float> &xs, F &&f) const -> void
+{
+  auto k = 0;
+  for (auto px = 0; px < width; ++px)
+  {
+    const auto x = columnX(px);
+    while (k + 1 < static_cast<int>(xs.size()) && xs[k + 1] <= x)
+      ++k;
+    if (k + 1 >= static_cast<int>(xs.size()))
+      break;
+    if (xs[k] <= x)
+      f(px, k, (x - xs[k]) / (xs[k + 1] - xs[k]));
+  }
+}
+
+SoftRend::SoftRend()
+  : width(config().width),
+    height(config().height),
+    startFreq(config().startFreq),
+    endFreq(config().endFreq),
+    binMap(width),
+    columnColor(width),
+    exponent(width),
+    upperPiano(width * 4),
+    lowerPiano(width * 4),
+    litKeys(width),
+    lineColors(LinesNum * width),
+    lines(LinesNum * width * 4),
+    spectrTop(width),
+    spectrColor(width * 4),
+    image(width * height * 4)
+{
+  for (auto px = 0; px < width; ++px)
+  {
+    const auto t = (px + .5f) / width;
+    const auto freq = startFreq * powf(endFreq / startFreq, t);
+    columnColor[px] = noteColor(freq);
+    exponent[px] = 2 - (freq - startFreq) / (endFreq - startFreq);
+  }
+  // the vertices of the GL keyboards: both edges of a key and the gap after it
+  for (int i = 0; i < PianoKeys; ++i)
+  {
+    keyXs.push_back(toX(55 * powf(2, (i - .46f) / 12.f)));
+    keyXs.push_back(toX(55 * powf(2, (i + .46f) / 12.f)));
+    keyXs.push_back(toX(55 * powf(2, (i + .50f) / 12.f)));
+  }
+  buildPiano(upperPiano, 0.063f, false);
+
+  std::vector<float> linearFreqs;
+  for (int i = 0; i < config().spectrSize / 2; ++i)
+    linearFreqs.push_back(1.f * i * config().sampleFreq / config().spectrSize);
+  setFreqs(std::move(linearFreqs));
+}
+
+auto SoftRend::setFreqs(std::vector<float> value) -> void
+{
+  freqs = std::move(value);
+  const auto idx = [this](float freq) {
+    return static_cast<int>(std::lower_bound(std::begin(freqs), std::end(freqs), freq) - std::begin(freqs));
+  };
+  strade = std::min(idx(endFreq) + 1, static_cast<int>(freqs.size()));
+  line = 0;
+
+  for (int px = 0; px < width; ++px)
+  {
+    const auto freq = startFreq * powf(endFreq / startFreq, (px + .5f) / width);
+    const auto k = std::clamp(idx(freq), 1, strade - 1);
+    binMap[px] = std::clamp(k - 1 + (freq - freqs[k - 1]) / (freqs[k] - freqs[k - 1]), 0.f, strade - 1.f);
+  }
+  xs.resize(strade);
+  for (auto i = 0; i < strade; ++i)
+    xs[i] = toX(freqs[i]);
+  waterfall.assign(strade * LinesNum, 0.f);
+  for (auto i = 0; i < LinesNum; ++i)
+    colorLine(i);
+}
+
+auto SoftRend::buildPiano(std::vector<uint8_t> &piano, float w, bool hasGrid) -> void
+{
+  constexpr bool isWhite[] = {
+    true, false, true, true, false, true, false, true, true, false, true, false};
+  std::vector<float> zs;
+  for (int i = 0; i < PianoKeys; ++i)
+  {
+    zs.push_back(isWhite[i % 12] ? w : 0);
+    zs.push_back(isWhite[i % 12] ? w : 0);
+    zs.push_back(0);
+  }
+  std::fill(std::begin(piano), std::end(piano), 0);
+  for (auto px = 0; px < width; ++px)
+    piano[px * 4 + 3] = 255;
+  forEachColumn(keyXs, [&](int px, int k, float t) {
+    const auto z = zs[k] + (zs[k + 1] - zs[k]) * t;
+    auto *p = piano.data() + px * 4;
+    if (hasGrid && isGridColumn(px))
+    {
+      // mix(red, color, 0.8)
+      p[0] = toByte(0.2f + 0.8f * z);
+      p[1] = p[2] = toByte(0.8f * z);
+    }
+    else
+      p[0] = p[1] = p[2] = toByte(z);
+  });
+}
+
+auto SoftRend::colorLine(int l) -> void
+{
+  const auto *bins = waterfall.data() + l * strade;
+  auto *colors = lineColors.data() + l * width;
+  auto *p = lines.data() + l * width * 4;
+  for (auto px = 0; px < width; ++px)
+  {
+    // GL_LINEAR with clamp to edge
+    const auto bin = binMap[px];
+    const auto i0 = static_cast<int>(bin);
+    const auto i1 = std::min(i0 + 1, strade - 1);
+    const auto z = bins[i0] + (bins[i1] - bins[i0]) * (bin - i0);
+    auto c = shade(columnColor[px], powf(std::max(z, 0.f), exponent[px]));
+    c = {std::clamp(c.r, 0.f, 1.f), std::clamp(c.g, 0.f, 1.f), std::clamp(c.b, 0.f, 1.f), std::clamp(c.a, 0.f, 1.f)};
+    colors[px] = c;
+    // glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA) over the upper keyboard
+    const auto *dst = upperPiano.data() + px * 4;
+    p[px * 4 + 0] = toByte(c.r * c.a + dst[0] / 255.f * (1 - c.a));
+    p[px * 4 + 1] = toByte(c.g * c.a + dst[1] / 255.f * (1 - c.a));
+    p[px * 4 + 2] = toByte(c.b * c.a + dst[2] / 255.f * (1 - c.a));
+    p[px * 4 + 3] = 255;
+  }
+}
+
+auto SoftRend::rend(const std::vector<float> &spectr, const std::vector<float> &notes, bool smartScale) -> void
+{
+  const auto w = smartScale ? 0.25f : 0.5f;
+  if (lowerPianoW != w)
+  {
+    buildPiano(lowerPiano, w, true);
+    lowerPianoW = w;
+  }
+
+  // the sounding notes in the color of the key, the alpha goes to 0 over the gaps between the keys
+  std::fill(std::begin(litKeys), std::end(litKeys), Color{0, 0, 0, 0});
+  if (!notes.empty())
+    forEachColumn(keyXs, [&](int px, int k, float t) {
+      const auto z0 = k % 3 == 2 ? 0 : notes[k / 3];
+      const auto z1 = (k + 1) % 3 == 2 ? 0 : notes[(k + 1) / 3];
+      const auto &c = NoteColors[k / 3 % 12];
+      litKeys[px] = {c[0], c[1], c[2], 0.8f * (z0 + (z1 - z0) * t)};
+    });
+
+  // the live spectrum, quads between the bins from the bottom of the screen up to y / 2 - 1
+  std::fill(std::begin(spectrTop), std::end(spectrTop), -2.f);
+  tallColumns.clear();
+  forEachColumn(xs, [&](int px, int k, float t) {
+    spectrTop[px] = (spectr[k] + (spectr[k + 1] - spectr[k]) * t) / 2 - 1;
+    // the colors are computed per vertex and interpolated
+    const auto c0 = shade(noteColor(freqs[k]), spectr[k]);
+    const auto c1 = shade(noteColor(freqs[k + 1]), spectr[k + 1]);
+    const auto dim = isGridColumn(px) ? 0.6f : 1.f;
+    auto *p = spectrColor.data() + px * 4;
+    p[0] = toByte(dim * (c0.r + (c1.r - c0.r) * t));
+    p[1] = toByte(dim * (c0.g + (c1.g - c0.g) * t));
+    p[2] = toByte(dim * (c0.b + (c1.b - c0.b) * t));
+    p[3] = 255;
+    if (spectrTop[px] > -0.5f)
+      tallColumns.push_back(px);
+  });
+
+  // the newest line goes on top of the ring
+  std::copy(spectr.data(), spectr.data() + strade, waterfall.data() + line * strade);
+  colorLine(line);
+  line = (line + LinesNum - 1) % LinesNum;
+  const auto offset = 1.f * line / LinesNum;
+
+  for (auto row = 0; row < height; ++row)
+  {
+    const auto y = rowY(row);
+    auto *dst = image.data() + row * width * 4;
+    if (y >= -0.5f)
+    {
+      const auto isBlank = y < -0.5f + 2.f / LinesNum || y > 1.f - 2.f / LinesNum;
+      auto l = 0;
+      if (isBlank)
+        memcpy(dst, upperPiano.data(), width * 4);
+      else
+      {
+        auto r = (y + 0.5f) / 1.5f + offset;
+        l = std::min(static_cast<int>((r - floorf(r)) * LinesNum), LinesNum - 1);
+        memcpy(dst, lines.data() + l * width * 4, width * 4);
+      }
+      // the spectrum is drawn before the waterfall
+      for (const auto px : tallColumns)
+      {
+        if (y >= spectrTop[px])
+          continue;
+        auto *p = dst + px * 4;
+        const auto *s = spectrColor.data() + px * 4;
+        if (isBlank)
+          memcpy(p, s, 4);
+        else
+        {
+          const auto &c = lineColors[l * width + px];
+          p[0] = toByte(c.r * c.a + s[0] / 255.f * (1 - c.a));
+          p[1] = toByte(c.g * c.a + s[1] / 255.f * (1 - c.a));
+          p[2] = toByte(c.b * c.a + s[2] / 255.f * (1 - c.a));
+        }
+      }
+    }
+    else
+    {
+      const auto isPiano = y >= -0.75f;
+      for (auto px = 0; px < width; ++px)
+      {
+        auto *p = dst + px * 4;
+        if (y < spectrTop[px])
+          memcpy(p, spectrColor.data() + px * 4, 4);
+        else if (isPiano)
+          memcpy(p, lowerPiano.data() + px * 4, 4);
+        else
+        {
+          p[0] = p[1] = p[2] = 0;
+          p[3] = 255;
+        }
+        // the lit keys are drawn after the spectrum
+        if (const auto &c = litKeys[px]; isPiano && c.a > 0)
+        {
+          p[0] = toByte(c.r * c.a + p[0] / 255.f * (1 - c.a));
+          p[1] = toByte(c.g * c.a + p[1] / 255.f * (1 - c.a));
+          p[2] = toByte(c.b * c.a + p[2] / 255.f * (1 - c.a));
+        }
+      }
+    }
+  }
+}
@@ -0,0 +1,70 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+// CPU rasterizer of the picture Rend draws with GL: the piano overlays, the live spectrum and the
+// waterfall, with the colors and the blending of the shaders. Needs neither a display nor a GPU.
+class SoftRend
+{
+public:
+  // unclamped shader output
+  struct Color
+  {
+    float r;
+    float g;
+    float b;
+    float a;
+  };
+
+  // takes the size and the frequency range from the config in effect
+  SoftRend();
+  // the same input as Rend::rend() for one lane, notes may be empty
+  auto rend(const std::vector<float> &spectr, const std::vector<float> &notes, bool smartScale) -> void;
+  auto setFreqs(std::vector<float> freqs) -> void;
+  // width x height opaque RGBA, the top row first
+  auto pixels() const -> const std::vector<uint8_t> & { return image; }
+
+private:
+  auto toX(float freq) const -> float;
+  auto columnX(int px) const -> float;
+  auto rowY(int row) const -> float;
+  auto isGridColumn(int px) const -> bool;
+  template <typename F>
+  auto forEachColumn(const std::vector<float> &xs, F &&f) const -> void;
+  // the lower keyboard has the red grid lines
+  auto buildPiano(std::vector<uint8_t> &piano, float w, bool hasGrid) -> void;
+  // colors a waterfall line after its bins changed
+  auto colorLine(int line) -> void;
+
+  int width;
+  int height;
+  float startFreq;
+  float endFreq;
+  std::vector<float> freqs;
+  // number of bins on the screen
+  int strade;
+  // per screen column: fractional bin, note color and brightness exponent of the waterfall
+  std::vector<float> binMap;
+  std::vector<Color> columnColor;
+  std::vector<float> exponent;
+  // RGBA per screen column, the lower keyboard depends on the smart scale mode
+  std::vector<uint8_t> upperPiano;
+  std::vector<uint8_t> lowerPiano;
+  float lowerPianoW = -1.f;
+  // screen positions of the keyboard vertices and the lit keys per screen column
+  std::vector<float> keyXs;
+  std::vector<Color> litKeys;
+  // LinesNum rows of strade bins, a ring like the GL texture
+  std::vector<float> waterfall;
+  // LinesNum rows of width colors before blending and the same rows blended over the upper keyboard
+  std::vector<Color> lineColors;
+  std::vector<uint8_t> lines;
+  int line = 0;
+  // screen positions of the bins
+  std::vector<float> xs;
+  // live spectrum per screen column
+  std::vector<float> spectrTop;
+  std::vector<uint8_t> spectrColor;
+  std::vector<int> tallColumns;
+  std::vector<uint8_t> image;
+};
@@ -0,0 +1,223 @@
+#include "spectral_norm.hpp"
+#include "config.hpp"
+#include "simd.hpp"
+#include <algorithm>
+#include <cmath>
+#include <log/log.hpp>
+
+namespace
+{
+  // keeps the division defined over digital silence
+  const auto MinEnvelope = 1e-3f;
+  // distance of the Poly band centers in octaves, a band spans two steps
+  const auto BandStep = 0.5f;
+  // weight of the bins above the plain fit in the second Poly pass
+  const auto PeakWeight = 8.f;
+  // keeps a band without bins solvable, it fits 0
+  const auto Ridge = 1e-2f;
+  // the sums per Poly band that make up its normal equations
+  const auto MomentsNum = 8;
+} // namespace
+
+auto toString(Envelope value) -> const char *
+{
+  switch (value)
+  {
+  case Envelope::None: return "off";
+  case Envelope::Iir: return "iir";
+  case Envelope::Cepstral: return "cepstral";
+  case Envelope::MinTrack: return "min-track";
+  case Envelope::Poly: return "poly";
+  case Envelope::Count: break;
+  }
+  return "unknown";
+}
+
+auto toEnvelope(const std::string &name) -> Envelope
+{
+  for (auto i = 0; i < static_cast<int>(Envelope::Count); ++i)
+    if (name == toString(static_cast<Envelope>(i)))
+      return static_cast<Envelope>(i);
+  LOG("Unknown envelope", name);
+  throw -24;
+}
+
+SpectralNorm::SpectralNorm(const std::vector<float> &freqs, float frameRate)
+  : size(freqs.size()),
+    frameRate(frameRate > 0 ? frameRate : 1.f * config().sampleFreq / config().hopSize)
+{
+  const auto idx = [&freqs](float freq) {
+    return static_cast<int>(std::lower_bound(std::begin(freqs), std::end(freqs), freq) - std::begin(freqs));
+  };
+  startIdx = idx(config().startFreq / 2.f);
+  endIdx = idx(config().endFreq * 2.f);
+  from = idx(config().startFreq);
+  to = idx(config().endFreq);
+  envelope.resize(endIdx - startIdx);
+  level.resize(endIdx - startIdx);
+  if (endIdx <= startIdx)
+    return;
+  dct = std::make_unique<Dct>(endIdx - startIdx);
+  logs.resize(endIdx - startIdx);
+  weights.resize(endIdx - startIdx);
+  const auto lo = log2f(freqs[startIdx]);
+  const auto bands = std::max(static_cast<int>(ceilf((log2f(freqs[endIdx - 1]) - lo) / BandStep)) + 1, 2);
+  fits = GaussianElimination::Batch(3, bands);
+  moments.resize(bands * MomentsNum);
+  for (auto i = startIdx; i < endIdx; ++i)
+  {
+    const auto x = log2f(freqs[i]) - lo;
+    const auto band = std::min(static_cast<int>(x / BandStep), bands - 2);
+    bandOf.push_back(band);
+    bandOffset.push_back(x - band * BandStep);
+  }
+}
+
+auto SpectralNorm::apply(const float *spectr, float *y, Envelope mode) -> void
+{
+  if (mode != Envelope::MinTrack)
+    isTracking = false;
+  if (mode == Envelope::None || envelope.empty())
+  {
+    // the displayed range may hold no bin of a coarse transform
+    const auto peak = from < to ? *std::max_element(spectr + from, spectr + to) : 0.f;
+    const auto max = std::max(peak, 1.5E+4f);
+    Simd::scale(spectr, 1.f / max, y, size);
+    return;
+  }
+
+  switch (mode)
+  {
+  case Envelope::Iir: iir(spectr); break;
+  case Envelope::Cepstral: cepstral(spectr); break;
+  case Envelope::MinTrack: minTrack(spectr); break;
+  case Envelope::Poly: poly(spectr); break;
+  default: break;
+  }
+  // a spectrum entirely under its envelope stays dim instead of being blown up
+  const auto k = 1.f / std::max(Simd::maxRatio(spectr + startIdx, envelope.data(), endIdx - startIdx), 1.f);
+  Simd::scale(spectr, k, y, startIdx);
+  Simd::divide(spectr + startIdx, envelope.data(), k, y + startIdx, endIdx - startIdx);
+  Simd::scale(spectr + endIdx, k, y + endIdx, size - endIdx);
+}
+
+// the recurrence runs along the bins, it stays scalar
+auto SpectralNorm::iir(const float *spectr) -> void
+{
+  float a = 0;
+  const auto filtK = 1.f / 64.f; // higher denominator harder filtering
+  for (auto s = startIdx; s < endIdx; ++s)
+  {
+    a = a + filtK * (spectr[s] - a);
+    envelope[s - startIdx] = a;
+  }
+  for (auto s = endIdx - 1; s >= startIdx; --s)
+  {
+    a = a + filtK * (envelope[s - startIdx] - a);
+    envelope[s - startIdx] = std::max(a, MinEnvelope);
+  }
+}
+
+// Keeps the lowest quefrencies of the log spectrum. The geometric mean envelope is not pulled up
+// by a few strong partials the way the linear filter is.
+auto SpectralNorm::cepstral(const float *spectr) -> void
+{
+  const auto n = endIdx - startIdx;
+  auto *c = dct->data();
+  for (auto i = 0; i < n; ++i)
+    c[i] = logf(std::max(spectr[startIdx + i], MinEnvelope));
+  dct->forward();
+  // the basis function k has a period of 2 * n / k bins, keep the ones longer than the 128 bins
+  // the IIR filter smooths over
+  const auto lifter = std::max(n / 64, 1);
+  std::fill(c + lifter, c + n, 0.f);
+  dct->inverse();
+  for (auto i = 0; i < n; ++i)
+    envelope[i] = std::max(expf(c[i] / (2 * n)), MinEnvelope);
+}
+
+// Minimum statistics: the floor follows the level down at once and rises at 2 dB/s, so the
+// envelope tracks the noise and the steady background while a held note takes tens of seconds to
+// sink into it
+auto SpectralNorm::minTrack(const float *spectr) -> void
+{
+  const auto n = endIdx - startIdx;
+  if (!isTracking)
+  {
+    std::copy(spectr + startIdx, spectr + endIdx, std::begin(level));
+    std::fill(std::begin(envelope), std::end(envelope), 1e30f);
+    isTracking = true;
+  }
+  // 50 ms smoothing of the level
+  const auto k = 1.f - expf(-1.f / (0.05f * frameRate));
+  const auto rise = powf(10.f, 2.f / 20.f / frameRate);
+  Simd::trackMinimum(spectr + startIdx, k, rise, MinEnvelope, level.data(), envelope.data(), n);
+}
+
+// A least squares fit of the log spectrum follows its mean, the bins above the first fit weigh more
+// in the second one so the envelope rides on the partials like the IIR one
+auto SpectralNorm::poly(const float *spectr) -> void
+{
+  const auto n = endIdx - startIdx;
+  for (auto i = 0; i < n; ++i)
+    logs[i] = logf(std::max(spectr[startIdx + i], MinEnvelope));
+  fitBands(nullptr);
+  for (auto i = 0; i < n; ++i)
+    weights[i] = logs[i] > envelope[i] ? PeakWeight : 1.f;
+  fitBands(weights.data());
+  for (auto i = 0; i < n; ++i)
+    envelope[i] = std::max(expf(envelope[i]), MinEnvelope);
+}
+
+// every bin is in the span of the band on its left and the one on its right, the envelope blends
+// the two quadratics over the step between their centers
+auto SpectralNorm::fitBands(const float *w) -> void
+{
+  const auto n = endIdx - startIdx;
+  // the normal equations of a + b u + c u^2 are the sums of w u^0..4 and of w u^0..2 l, summed per
+  // band first and spread into the systems after
+  std::fill(std::begin(moments), std::end(moments), 0.f);
+  for (auto i = 0; i < n; ++i)
+  {
+    const auto wi = w ? w[i] : 1.f;
+    const auto l = logs[i];
+    for (auto b = 0; b < 2; ++b)
+    {
+      auto *m = moments.data() + (bandOf[i] + b) * MomentsNum;
+      const auto u = bandOffset[i] - b * BandStep;
+      const auto u2 = u * u;
+      m[0] += wi;
+      m[1] += wi * u;
+      m[2] += wi * u2;
+      m[3] += wi * u2 * u;
+      m[4] += wi * u2 * u2;
+      m[5] += wi * l;
+      m[6] += wi * u * l;
+      m[7] += wi * u2 * l;
+    }
+  }
+  for (auto band = 0; band < fits.count(); ++band)
+  {
+    const auto *m = moments.data() + band * MomentsNum;
+    for (auto r = 0; r < 3; ++r)
+    {
+      for (auto c = 0; c < 3; ++c)
+        fits.at(r, c)[band] = m[r + c] + (r == c ? Ridge : 0.f);
+      fits.at(r, 3)[band] = m[5 + r];
+    }
+  }
+  fits.solve();
+
+  const auto *a = fits.at(0, 3);
+  const auto *b = fits.at(1, 3);
+  const auto *c = fits.at(2, 3);
+  for (auto i = 0; i < n; ++i)
+  {
+    const auto k = bandOf[i];
+    const auto u = bandOffset[i];
+    const auto v = u - BandStep;
+    const auto left = a[k] + u * (b[k] + u * c[k]);
+    const auto right = a[k + 1] + v * (b[k + 1] + v * c[k + 1]);
+    envelope[i] = left + u / BandStep * (right - left);
+  }
+}
@@ -0,0 +1,63 @@
+#pragma once
+#include "fft.hpp"
+#include "gaussian_elimination.hpp"
+#include <memory>
+#include <string>
+#include <vector>
+
+// How the smart scale estimates the spectral envelope the bins are divided by
+enum class Envelope {
+  None,     // no smart scale, the spectrum is only scaled to its maximum
+  Iir,      // forward-backward one-pole filter over the bins
+  Cepstral, // low quefrencies of the log spectrum
+  MinTrack, // per bin noise floor, the minimum of the smoothed level over time
+  Poly,     // quadratic fits of the log spectrum over overlapping octaves, drawn to the peaks
+  Count
+};
+
+auto toString(Envelope) -> const char *;
+// the inverse of toString(), throws on an unknown name
+auto toEnvelope(const std::string &) -> Envelope;
+
+// Scales a spectrum to the 0..1 display range. With smart scale the bins are divided by the
+// spectral envelope first. MinTrack keeps state between the frames, so one instance should see
+// one stream of consecutive frames.
+class SpectralNorm
+{
+public:
+  // frameRate is the number of frames per second apply() gets, 0 for the hop rate of the config
+  SpectralNorm(const std::vector<float> &freqs = {}, float frameRate = 0);
+  // y[i] = spectr[i] / envelope[i] / max, y may be spectr
+  auto apply(const float *spectr, float *y, Envelope) -> void;
+
+private:
+  auto iir(const float *spectr) -> void;
+  auto cepstral(const float *spectr) -> void;
+  auto minTrack(const float *spectr) -> void;
+  auto poly(const float *spectr) -> void;
+  // least squares fits of the log spectrum per band, weights may be null; the log envelope goes to
+  // envelope
+  auto fitBands(const float *weights) -> void;
+
+  int size;
+  // envelope range
+  int startIdx;
+  int endIdx;
+  // range to look for the maximum without smart scale
+  int from;
+  int to;
+  float frameRate;
+  std::vector<float> envelope;
+  // Cepstral state, planned with the rest so apply() never plans an FFT
+  std::unique_ptr<Dct> dct;
+  // MinTrack state: the smoothed level, the floor is kept in envelope
+  std::vector<float> level;
+  bool isTracking = false;
+  // Poly state: a quadratic per band, the band left of every bin and the octaves from its center
+  GaussianElimination::Batch fits;
+  std::vector<float> moments;
+  std::vector<int> bandOf;
+  std::vector<float> bandOffset;
+  std::vector<float> logs;
+  std::vector<float> weights;
+};
@@ -0,0 +1,113 @@
+#include "stft.hpp"
+#include "profiler.hpp"
+#include "simd.hpp"
+#include <algorithm>
+#include <cmath>
+#include <log/log.hpp>
+#include <numeric>
+
+auto toString(WindowType value) -> const char *
+{
+  switch (value)
+  {
+  case WindowType::Hann: return "Hann";
+  case WindowType::BlackmanHarris: return "Blackman-Harris";
+  case WindowType::ExpDecay: return "exponential decay";
+  case WindowType::Rectangular: return "rectangular";
+  }
+  return "unknown";
+}
+
+auto toWindowType(const std::string &name) -> WindowType
+{
+  // the rectangular window is for the transforms which bring their own, it has no name
+  if (name == "hann")
+    return WindowType::Hann;
+  if (name == "blackman-harris")
+    return WindowType::BlackmanHarris;
+  if (name == "exp-decay")
+    return WindowType::ExpDecay;
+  LOG("Unknown window", name);
+  throw -22;
+}
+
+auto windowLevel(int size) -> double
+{
+  auto res = 0.;
+  for (auto i = 0; i < size; ++i)
+    res += expf(-0.00025f * (size - i));
+  return res;
+}
+
+static auto makeWindow(WindowType type, int size) -> std::vector<float>
+{
+  std::vector<float> res(size);
+  const auto pi = 3.14159265358979;
+  for (auto i = 0; i < size; ++i)
+  {
+    const auto x = 2 * pi * i / size;
+    switch (type)
+    {
+    case WindowType::Hann: res[i] = 0.5 - 0.5 * cos(x); break;
+    case WindowType::BlackmanHarris:
+      res[i] = 0.35875 - 0.48829 * cos(x) + 0.14128 * cos(2 * x) - 0.01168 * cos(3 * x);
+      break;
+    case WindowType::ExpDecay: res[i] = expf(-0.00025f * (size - i)); break;
+    case WindowType::Rectangular: res[i] = 1; break;
+    }
+  }
+  // keep the levels of all the windows comparable to the original exponential decay one, the
+  // renderer normalization depends on them
+  const auto k = windowLevel(size) / std::accumulate(std::begin(res), std::end(res), 0.);
+  for (auto &w : res)
+    w *= k;
+  return res;
+}
+
+Stft::Stft(StftParams p) : p(p), history(p.windowSize), window(makeWindow(p.window, p.windowSize)), fft(p.fftSize)
+{
+}
+
+auto Stft::setWindow(WindowType value) -> void
+{
+  p.window = value;
+  window = makeWindow(value, p.windowSize);
+}
+
+auto Stft::reset() -> void
+{
+  std::fill(std::begin(history), std::end(history), 0);
+  pos = 0;
+  sinceFrame = 0;
+}
+
+auto Stft::append(const int16_t *samples, int size) -> void
+{
+  while (size > 0)
+  {
+    const auto n = std::min(size, p.windowSize - pos);
+    std::copy(samples, samples + n, history.data() + pos);
+    samples += n;
+    size -= n;
+    pos = (pos + n) % p.windowSize;
+  }
+}
+
+auto Stft::execute() -> const fftwf_complex *
+{
+  {
+    ScopedTimer timer("window");
+    // the zero padding tail of the input is never written, r2c plans preserve their input
+    Simd::windowRing(history.data(), p.windowSize, pos, window.data(), fft.in());
+  }
+  ScopedTimer timer("fft");
+  fft.execute();
+  return fft.out();
+}
+
+auto Stft::frame(const int16_t *samples) -> const fftwf_complex *
+{
+  Simd::window(samples, window.data(), fft.in(), p.windowSize);
+  fft.execute();
+  return fft.out();
+}
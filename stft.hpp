@@ -0,0 +1,71 @@
+#pragma once
+#include "fft.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+enum class WindowType { Hann, BlackmanHarris, ExpDecay, Rectangular };
+
+struct StftParams
+{
+  int windowSize;
+  // fftSize > windowSize zero-pads the frame
+  int fftSize;
+  int hopSize;
+  WindowType window;
+};
+
+auto toString(WindowType) -> const char *;
+// the window of a config name: hann, blackman-harris or exp-decay; throws on an unknown name
+auto toWindowType(const std::string &) -> WindowType;
+// sum of the exponential decay window of the given size, all the windows are scaled to it so a
+// sinusoid peaks at the same level whatever the window
+auto windowLevel(int size) -> double;
+
+// Short-time Fourier transform over a sample stream. Samples are fed in arbitrary chunks and a
+// frame is produced every hopSize samples, independently of how the audio driver splits them.
+class Stft
+{
+public:
+  Stft(StftParams);
+  auto params() const -> const StftParams & { return p; }
+  // keeps the sample history
+  auto setWindow(WindowType) -> void;
+  // zeroes the sample history, as if the stream started over
+  auto reset() -> void;
+  // number of bins in a frame
+  auto size() const -> int { return p.fftSize / 2 + 1; }
+  // transforms windowSize contiguous samples, random access alternative to push(); gives exactly
+  // the same bins as push() does for the same samples
+  auto frame(const int16_t *samples) -> const fftwf_complex *;
+  // calls onFrame(const fftwf_complex *bins) for every completed hop
+  template <typename F>
+  auto push(const int16_t *samples, int size, F &&onFrame) -> void
+  {
+    while (size > 0)
+    {
+      const auto n = std::min(size, p.hopSize - sinceFrame);
+      append(samples, n);
+      samples += n;
+      size -= n;
+      sinceFrame += n;
+      if (sinceFrame == p.hopSize)
+      {
+        sinceFrame = 0;
+        onFrame(execute());
+      }
+    }
+  }
+
+private:
+  auto append(const int16_t *samples, int size) -> void;
+  auto execute() -> const fftwf_complex *;
+
+  StftParams p;
+  std::vector<int16_t> history;
+  int pos = 0;
+  int sinceFrame = 0;
+  std::vector<float> window;
+  Fft fft;
+};
@@ -0,0 +1,97 @@
+#include "thread_pool.hpp"
+#include <algorithm>
+
+ThreadPool::ThreadPool(int threadsNum) : workers(std::max(threadsNum, 1))
+{
+  for (auto i = 0U; i < workers.size(); ++i)
+    threads.emplace_back([this, i]() { run(i); });
+}
+
+ThreadPool::~ThreadPool()
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    done = true;
+  }
+  cv.notify_all();
+  for (auto &t : threads)
+    t.join();
+}
+
+auto ThreadPool::parallelFor(int64_t begin,
+                             int64_t end,
+                             int64_t grain,
+                             const std::function<void(int64_t, int64_t, int)> &f) -> void
+{
+  if (begin >= end)
+    return;
+  std::unique_lock<std::mutex> lock(mutex);
+  job = &f;
+  grain = std::max<int64_t>(grain, 1);
+  const auto chunks = (end - begin + grain - 1) / grain;
+  pending = chunks;
+  // contiguous runs of chunks per worker, stealing balances the rest
+  for (auto c = int64_t{0}; c < chunks; ++c)
+  {
+    auto &w = workers[c * workers.size() / chunks];
+    std::lock_guard<std::mutex> workerLock(w.mutex);
+    w.tasks.emplace_back(begin + c * grain, std::min(end, begin + (c + 1) * grain));
+  }
+  ++generation;
+  cv.notify_all();
+  doneCv.wait(lock, [this]() { return pending == 0; });
+  job = nullptr;
+}
+
+auto ThreadPool::take(int idx, Task &task) -> bool
+{
+  {
+    auto &w = workers[idx];
+    std::lock_guard<std::mutex> lock(w.mutex);
+    if (!w.tasks.empty())
+    {
+      task = w.tasks.front();
+      w.tasks.pop_front();
+      return true;
+    }
+  }
+  for (auto i = 1U; i < workers.size(); ++i)
+  {
+    auto &w = workers[(idx + i) % workers.size()];
+    std::lock_guard<std::mutex> lock(w.mutex);
+    if (!w.tasks.empty())
+    {
+      task = w.tasks.back();
+      w.tasks.pop_back();
+      return true;
+    }
+  }
+  return false;
+}
+
+auto ThreadPool::run(int idx) -> void
+{
+  auto seen = uint64_t{0};
+  for (;;)
+  {
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      cv.wait(lock, [this, seen]() { return done || generation != seen; });
+      if (done)
+        return;
+      seen = generation;
+    }
+    // the job pointer is published before the tasks, taking a task under the worker mutex makes
+    // it visible
+    Task task;
+    while (take(idx, task))
+    {
+      (*job)(task.first, task.second, idx);
+      if (--pending == 0)
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        doneCv.notify_all();
+      }
+    }
+  }
+}
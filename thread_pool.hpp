@@ -0,0 +1,47 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// Fixed size pool of workers with per-worker task deques. Every worker takes tasks from the front
+// of its own deque and, once it runs dry, steals from the back of the others.
+class ThreadPool
+{
+public:
+  ThreadPool(int threads = std::thread::hardware_concurrency());
+  ~ThreadPool();
+  auto size() const -> int { return static_cast<int>(threads.size()); }
+  // splits [begin, end) into chunks of grain elements, calls f(from, to, worker) for every chunk and
+  // returns when all of them are done; worker is in [0, size()) and can index per-worker state
+  auto parallelFor(int64_t begin,
+                   int64_t end,
+                   int64_t grain,
+                   const std::function<void(int64_t, int64_t, int)> &f) -> void;
+
+private:
+  using Task = std::pair<int64_t, int64_t>;
+  struct Worker
+  {
+    std::mutex mutex;
+    std::deque<Task> tasks;
+  };
+
+  auto run(int idx) -> void;
+  auto take(int idx, Task &) -> bool;
+
+  std::vector<Worker> workers;
+  std::vector<std::thread> threads;
+  const std::function<void(int64_t, int64_t, int)> *job = nullptr;
+  std::mutex mutex;
+  std::condition_variable cv;
+  std::condition_variable doneCv;
+  uint64_t generation = 0;
+  std::atomic<int64_t> pending{0};
+  bool done = false;
+};
@@ -0,0 +1,53 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+
+// Lock-free single-producer/single-consumer mailbox. The producer fills back() and publishes it,
+// the consumer picks up the latest published value with update(). Neither side waits for the
+// other: a value published before the consumer got to it is overwritten (dropped), and the
+// consumer keeps the previous value when nothing new was published (repeated).
+template <typename T>
+class TripleBuffer
+{
+public:
+  TripleBuffer() = default;
+  TripleBuffer(const T &init) : slots{init, init, init} {}
+
+  // producer side
+  auto back() -> T & { return slots[backIdx]; }
+  auto publish() -> void
+  {
+    const auto prev = middle.exchange(backIdx | FreshBit, std::memory_order_acq_rel);
+    if (prev & FreshBit)
+      droppedNum.fetch_add(1, std::memory_order_relaxed);
+    backIdx = prev & IdxMask;
+  }
+
+  // consumer side, returns false if nothing was published since the last call
+  auto update() -> bool
+  {
+    if (!(middle.load(std::memory_order_relaxed) & FreshBit))
+    {
+      repeatedNum.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    }
+    frontIdx = middle.exchange(frontIdx, std::memory_order_acq_rel) & IdxMask;
+    return true;
+  }
+  auto front() const -> const T & { return slots[frontIdx]; }
+
+  // values overwritten before the consumer saw them
+  auto dropped() const -> unsigned long long { return droppedNum; }
+  // update() calls which found nothing new
+  auto repeated() const -> unsigned long long { return repeatedNum; }
+
+private:
+  static constexpr uint8_t FreshBit = 4;
+  static constexpr uint8_t IdxMask = 3;
+  T slots[3];
+  uint8_t backIdx = 0;
+  alignas(64) std::atomic<uint8_t> middle{1};
+  alignas(64) uint8_t frontIdx = 2;
+  std::atomic<unsigned long long> droppedNum{0};
+  std::atomic<unsigned long long> repeatedNum{0};
+};